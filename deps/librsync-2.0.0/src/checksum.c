@@ -29,6 +29,7 @@
 
 #include "librsync.h"
 #include "checksum.h"
+#include "rollsum.h"
 #include "blake2.h"
 
 
@@ -43,22 +44,13 @@ int checksum_seed = 0;
  */
 unsigned int rs_calc_weak_sum(void const *p, int len)
 {
-        int i;
-        unsigned        s1, s2;
-        unsigned char const    *buf = (unsigned char const *) p;
+        Rollsum sum;
 
-        s1 = s2 = 0;
-        for (i = 0; i < (len - 4); i += 4) {
-                s2 += 4 * (s1 + buf[i]) + 3 * buf[i + 1] +
-                        2 * buf[i + 2] + buf[i + 3] + 10 * RS_CHAR_OFFSET;
-                s1 += (buf[i + 0] + buf[i + 1] + buf[i + 2] + buf[i + 3] +
-                       4 * RS_CHAR_OFFSET);
-        }
-        for (; i < len; i++) {
-                s1 += (buf[i] + RS_CHAR_OFFSET);
-                s2 += s1;
-        }
-        return (s1 & 0xffff) + (s2 << 16);
+        /* the same sum as the rolling one, which is vectorized */
+        RollsumInit(&sum);
+        RollsumUpdate(&sum, (unsigned char const *) p, len);
+
+        return (unsigned int) RollsumDigest(&sum);
 }
 
 
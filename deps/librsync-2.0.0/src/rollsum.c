@@ -19,6 +19,7 @@
  * along with this program; if not, write to the Free Software
  * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
  */
+#include <stddef.h>
 #include "rollsum.h"
 
 #define DO1(buf,i)  {s1 += buf[i]; s2 += s1;}
@@ -28,7 +29,61 @@
 #define DO16(buf)   DO8(buf,0); DO8(buf,8);
 #define OF16(off)  {s1 += 16*off; s2 += 136*off;}
 
+typedef void (*RollsumUpdateFn)(Rollsum *sum,const unsigned char *buf,unsigned int len);
+
+static void RollsumUpdateScalar(Rollsum *sum,const unsigned char *buf,unsigned int len);
+
+/* Spans shorter than this aren't worth going through a vector unit for. */
+#define ROLLSUM_SIMD_MIN_LEN 64
+
+#if defined(RS_ROLLSUM_DISPATCH)
+/* Picks the fastest RollsumUpdate() the CPU supports. The SSE4.1 and AVX2
+ * versions are only built for x86-64 with GCC or Clang, which is when
+ * RS_ROLLSUM_DISPATCH is defined. */
+static RollsumUpdateFn RollsumSelect(void) {
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2"))
+        return RollsumUpdateAVX2;
+    else if (__builtin_cpu_supports("sse4.1"))
+        return RollsumUpdateSSE41;
+
+    return RollsumUpdateScalar;
+}
+#endif
+
+/* The RollsumUpdate() to go through for long spans. */
+static RollsumUpdateFn RollsumGetUpdate(void) {
+#if defined(RS_ROLLSUM_DISPATCH)
+    /* Deltas are generated on several threads at once. Threads that race to
+     * pick the kernel all pick and store the same one, and the atomics keep
+     * that well defined. */
+    static RollsumUpdateFn update = NULL;
+    RollsumUpdateFn selected = __atomic_load_n(&update, __ATOMIC_ACQUIRE);
+
+    if (selected == NULL) {
+        selected = RollsumSelect();
+        __atomic_store_n(&update, selected, __ATOMIC_RELEASE);
+    }
+
+    return selected;
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    return RollsumUpdateNEON;
+#else
+    return RollsumUpdateScalar;
+#endif
+}
+
 void RollsumUpdate(Rollsum *sum,const unsigned char *buf,unsigned int len) {
+    if (len < ROLLSUM_SIMD_MIN_LEN) {
+        RollsumUpdateScalar(sum, buf, len);
+        return;
+    }
+
+    RollsumGetUpdate()(sum, buf, len);
+}
+
+static void RollsumUpdateScalar(Rollsum *sum,const unsigned char *buf,unsigned int len) {
     /* ANSI C says no overflow for unsigned. 
      zlib's adler 32 goes to extra effort to avoid overflow*/
     unsigned long s1 = sum->s1;
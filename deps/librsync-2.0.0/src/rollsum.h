@@ -36,6 +36,26 @@ typedef struct _Rollsum {
 } Rollsum;
 
 void RollsumUpdate(Rollsum *sum,const unsigned char *buf,unsigned int len);
+
+/* Vectorized implementations of RollsumUpdate(), see rollsum.c for how
+ * one is picked. They produce the exact same sums as the scalar one. */
+void RollsumUpdateSSE41(Rollsum *sum,const unsigned char *buf,unsigned int len);
+void RollsumUpdateAVX2(Rollsum *sum,const unsigned char *buf,unsigned int len);
+void RollsumUpdateNEON(Rollsum *sum,const unsigned char *buf,unsigned int len);
+
+/* The vectorized implementations sum spans of up to this many bytes in 32
+ * bit lanes, which is as much as they can take without overflowing, before
+ * folding them into s1 and s2. */
+#define ROLLSUM_SIMD_SPAN 16384
+
+/* Folds an n byte span into s1 and s2, given the sum of its bytes and the
+ * sum of every byte times its distance from the end of the span (n for the
+ * first byte, 1 for the last.) */
+#define ROLLSUM_SIMD_FOLD(s1,s2,n,bytes,weighted) { \
+    unsigned long n_ = (n); \
+    (s2) += n_*(s1) + (weighted) + ROLLSUM_CHAR_OFFSET*(n_*(n_+1)/2); \
+    (s1) += (bytes) + ROLLSUM_CHAR_OFFSET*n_; \
+}
 /* The following are implemented as macros.
 void RollsumInit(Rollsum *sum);
 void RollsumRotate(Rollsum *sum,unsigned char out, unsigned char in);
@@ -0,0 +1,82 @@
+/*= -*- c-basic-offset: 4; indent-tabs-mode: nil; -*-
+ *
+ * rollsum -- AVX2 implementation of RollsumUpdate()
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* Built with -mavx2 and only called when the CPU supports it, see
+ * rollsum.c. */
+
+#include <immintrin.h>
+#include "rollsum.h"
+
+/* Sums the 32 bit lanes of v. */
+static unsigned long hsum_epi32(__m256i v)
+{
+    unsigned int lanes[8];
+    unsigned long total = 0;
+    int i;
+
+    _mm256_storeu_si256((__m256i *) lanes, v);
+
+    for (i = 0; i < 8; i++)
+        total += lanes[i];
+
+    return total;
+}
+
+void RollsumUpdateAVX2(Rollsum *sum, const unsigned char *buf, unsigned int len)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i ones = _mm256_set1_epi16(1);
+    const __m256i weights = _mm256_setr_epi8(
+        32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17,
+        16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+    unsigned long s1 = sum->s1;
+    unsigned long s2 = sum->s2;
+
+    sum->count += len;
+
+    while (len >= 32) {
+        unsigned int n = len < ROLLSUM_SIMD_SPAN ? len & ~31u : ROLLSUM_SIMD_SPAN;
+        unsigned int i;
+        __m256i v_s1 = zero;    /* sum of the bytes */
+        __m256i v_ps = zero;    /* sum of v_s1 before every 32 byte chunk */
+        __m256i v_s2 = zero;    /* bytes weighted by their distance to the chunk end */
+
+        for (i = 0; i < n; i += 32) {
+            const __m256i bytes = _mm256_loadu_si256((const __m256i *) (buf + i));
+
+            v_ps = _mm256_add_epi32(v_ps, v_s1);
+            v_s1 = _mm256_add_epi32(v_s1, _mm256_sad_epu8(bytes, zero));
+            v_s2 = _mm256_add_epi32(v_s2, _mm256_madd_epi16(_mm256_maddubs_epi16(bytes, weights), ones));
+        }
+
+        ROLLSUM_SIMD_FOLD(s1, s2, n, hsum_epi32(v_s1), 32 * hsum_epi32(v_ps) + hsum_epi32(v_s2));
+
+        buf += n;
+        len -= n;
+    }
+
+    while (len != 0) {
+        s1 += (*buf++ + ROLLSUM_CHAR_OFFSET);
+        s2 += s1;
+        len--;
+    }
+
+    sum->s1 = s1;
+    sum->s2 = s2;
+}
@@ -0,0 +1,81 @@
+/*= -*- c-basic-offset: 4; indent-tabs-mode: nil; -*-
+ *
+ * rollsum -- NEON implementation of RollsumUpdate()
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* NEON is always there on AArch64, and on 32 bit ARM when the compiler
+ * is told it can use it, so there's nothing to pick at runtime; see
+ * rollsum.c. */
+
+#include "rollsum.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+
+/* Sums the 32 bit lanes of v. */
+static unsigned long hsum_u32(uint32x4_t v)
+{
+    return (unsigned long) vgetq_lane_u32(v, 0) + vgetq_lane_u32(v, 1) +
+        vgetq_lane_u32(v, 2) + vgetq_lane_u32(v, 3);
+}
+
+void RollsumUpdateNEON(Rollsum *sum, const unsigned char *buf, unsigned int len)
+{
+    static const unsigned char weights[16] = {
+        16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1 };
+    const uint8x8_t w_high = vld1_u8(weights);
+    const uint8x8_t w_low = vld1_u8(weights + 8);
+    unsigned long s1 = sum->s1;
+    unsigned long s2 = sum->s2;
+
+    sum->count += len;
+
+    while (len >= 16) {
+        unsigned int n = len < ROLLSUM_SIMD_SPAN ? len & ~15u : ROLLSUM_SIMD_SPAN;
+        unsigned int i;
+        uint32x4_t v_s1 = vdupq_n_u32(0);   /* sum of the bytes */
+        uint32x4_t v_ps = vdupq_n_u32(0);   /* sum of v_s1 before every 16 byte chunk */
+        uint32x4_t v_s2 = vdupq_n_u32(0);   /* bytes weighted by their distance to the chunk end */
+
+        for (i = 0; i < n; i += 16) {
+            const uint8x16_t bytes = vld1q_u8(buf + i);
+            uint16x8_t weighted;
+
+            v_ps = vaddq_u32(v_ps, v_s1);
+            v_s1 = vpadalq_u16(v_s1, vpaddlq_u8(bytes));
+
+            weighted = vmull_u8(vget_low_u8(bytes), w_high);
+            weighted = vmlal_u8(weighted, vget_high_u8(bytes), w_low);
+            v_s2 = vpadalq_u16(v_s2, weighted);
+        }
+
+        ROLLSUM_SIMD_FOLD(s1, s2, n, hsum_u32(v_s1), 16 * hsum_u32(v_ps) + hsum_u32(v_s2));
+
+        buf += n;
+        len -= n;
+    }
+
+    while (len != 0) {
+        s1 += (*buf++ + ROLLSUM_CHAR_OFFSET);
+        s2 += s1;
+        len--;
+    }
+
+    sum->s1 = s1;
+    sum->s2 = s2;
+}
+#endif
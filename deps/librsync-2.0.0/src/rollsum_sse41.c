@@ -0,0 +1,76 @@
+/*= -*- c-basic-offset: 4; indent-tabs-mode: nil; -*-
+ *
+ * rollsum -- SSE4.1 implementation of RollsumUpdate()
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* Built with -msse4.1 and only called when the CPU supports it, see
+ * rollsum.c. */
+
+#include <smmintrin.h>
+#include "rollsum.h"
+
+/* Sums the 32 bit lanes of v. */
+static unsigned long hsum_epi32(__m128i v)
+{
+    unsigned int lanes[4];
+
+    _mm_storeu_si128((__m128i *) lanes, v);
+
+    return (unsigned long) lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+void RollsumUpdateSSE41(Rollsum *sum, const unsigned char *buf, unsigned int len)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ones = _mm_set1_epi16(1);
+    const __m128i weights = _mm_setr_epi8(
+        16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+    unsigned long s1 = sum->s1;
+    unsigned long s2 = sum->s2;
+
+    sum->count += len;
+
+    while (len >= 16) {
+        unsigned int n = len < ROLLSUM_SIMD_SPAN ? len & ~15u : ROLLSUM_SIMD_SPAN;
+        unsigned int i;
+        __m128i v_s1 = zero;    /* sum of the bytes */
+        __m128i v_ps = zero;    /* sum of v_s1 before every 16 byte chunk */
+        __m128i v_s2 = zero;    /* bytes weighted by their distance to the chunk end */
+
+        for (i = 0; i < n; i += 16) {
+            const __m128i bytes = _mm_loadu_si128((const __m128i *) (buf + i));
+
+            v_ps = _mm_add_epi32(v_ps, v_s1);
+            v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(bytes, zero));
+            v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(_mm_maddubs_epi16(bytes, weights), ones));
+        }
+
+        ROLLSUM_SIMD_FOLD(s1, s2, n, hsum_epi32(v_s1), 16 * hsum_epi32(v_ps) + hsum_epi32(v_s2));
+
+        buf += n;
+        len -= n;
+    }
+
+    while (len != 0) {
+        s1 += (*buf++ + ROLLSUM_CHAR_OFFSET);
+        s2 += s1;
+        len--;
+    }
+
+    sum->s1 = s1;
+    sum->s2 = s2;
+}
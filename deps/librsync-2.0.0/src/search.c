@@ -45,104 +45,70 @@
 #include "search.h"
 #include "checksum.h"
 
-#define TABLE_SIZE (1<<16)
-#define NULL_TAG (-1)
-
-#define gettag2(s1,s2) (((s1) + (s2)) & 0xFFFF)
-#define gettag(sum) gettag2((sum)&0xFFFF,(sum)>>16)
-
-static void swap(rs_target_t *t1, rs_target_t *t2) {
-    unsigned short ts = t1->t;
-    t1->t = t2->t;
-    t2->t = ts;
+/*
+ * Blocks are indexed in an open-addressing table with linear probing, keyed
+ * on the weak sum. The table is kept at most half full so that probe
+ * sequences stay short, and each slot is small enough that a lookup which
+ * misses usually touches a single cache line.
+ */
 
-    int ti = t1->i;
-    t1->i = t2->i;
-    t2->i = ti;
-}
+#define MIN_TABLE_BITS 4
 
-static int rs_compare_targets(rs_target_t const *t1, rs_target_t const *t2, rs_signature_t * sums) {
-    int v = (int) t1->t - (int) t2->t;
-    if (v != 0)
-        return v;
+/* Fibonacci hashing: the weak sum has poor entropy in its low bits, so
+ * spread it with a multiply and take the top bits. */
+#define slot_of(sum, bits) (((rs_weak_sum_t) ((sum) * 0x9E3779B1U)) >> (32 - (bits)))
 
-    rs_weak_sum_t w1 = sums->block_sigs[t1->i].weak_sum;
-    rs_weak_sum_t w2 = sums->block_sigs[t2->i].weak_sum;
+static unsigned int strong_prefix(rs_signature_t const *sig,
+                                  unsigned char const *sum)
+{
+    unsigned int prefix = 0;
+    size_t len = sig->strong_sum_len;
 
-    v = (w1 > w2) - (w1 < w2);
-    if (v != 0)
-        return v;
+    if (len > sizeof(prefix))
+        len = sizeof(prefix);
 
-    return memcmp(sums->block_sigs[t1->i].strong_sum,
-            sums->block_sigs[t2->i].strong_sum,
-            sums->strong_sum_len);
-}
-
-static void heap_sort(rs_signature_t * sums) {
-    unsigned int i, j, n, k, p;
-    for (i = 1; i < sums->count; ++i) {
-        for (j = i; j > 0;) {
-            p = (j - 1) >> 1;
-            if (rs_compare_targets(&sums->targets[j], &sums->targets[p], sums) > 0)
-                swap(&sums->targets[j], &sums->targets[p]);
-            else
-                break;
-            j = p;
-        }
-    }
-
-    for (n = sums->count - 1; n > 0;) {
-        swap(&sums->targets[0], &sums->targets[n]);
-        --n;
-        for (i = 0; ((i << 1) + 1) <= n;) {
-            k = (i << 1) + 1;
-            if ((k + 1 <= n) && (rs_compare_targets(&sums->targets[k], &sums->targets[k + 1], sums) < 0))
-                k = k + 1;
-            if (rs_compare_targets(&sums->targets[k], &sums->targets[i], sums) > 0)
-                swap(&sums->targets[k], &sums->targets[i]);
-            else
-                break;
-            i = k;
-        }
-    }
+    memcpy(&prefix, sum, len);
+    return prefix;
 }
 
 rs_result
 rs_build_hash_table(rs_signature_t * sums)
 {
+    unsigned int bits = MIN_TABLE_BITS;
+    unsigned int mask;
     int i;
 
-    sums->tag_table = calloc(TABLE_SIZE, sizeof(sums->tag_table[0]));
-    if (!sums->tag_table)
+    while (bits < 31 && ((size_t) 1 << bits) < (size_t) sums->count * 2)
+        ++bits;
+
+    sums->hashtable = calloc((size_t) 1 << bits, sizeof(rs_sig_slot_t));
+    if (!sums->hashtable)
         return RS_MEM_ERROR;
 
-    if (sums->count > 0) {
-        sums->targets = calloc(sums->count, sizeof(rs_target_t));
-        if (!sums->targets) {
-            free(sums->tag_table);
-            sums->tag_table = NULL;
-            return RS_MEM_ERROR;
-        }
+    sums->hashtable_bits = bits;
+    mask = (1U << bits) - 1;
 
-        for (i = 0; i < sums->count; i++) {
-            sums->targets[i].i = i;
-            sums->targets[i].t = gettag(sums->block_sigs[i].weak_sum);
+    for (i = 0; i < sums->count; i++) {
+        rs_block_sig_t const *b = &sums->block_sigs[i];
+        unsigned int prefix = strong_prefix(sums, b->strong_sum);
+        unsigned int h = slot_of(b->weak_sum, bits);
+        rs_sig_slot_t *slot;
+
+        for (; (slot = &sums->hashtable[h])->i != 0; h = (h + 1) & mask) {
+            /* Identical blocks only need to be found once; keep the first
+             * so matches always refer to the earliest copy. */
+            if (slot->weak_sum == b->weak_sum
+                && slot->strong_prefix == prefix
+                && memcmp(sums->block_sigs[slot->i - 1].strong_sum,
+                          b->strong_sum, sums->strong_sum_len) == 0)
+                break;
         }
 
-        heap_sort(sums);
-    }
-
-    for (i = 0; i < TABLE_SIZE; i++) {
-        sums->tag_table[i].l = NULL_TAG;
-        sums->tag_table[i].r = NULL_TAG;
-    }
-
-    for (i = sums->count - 1; i >= 0; i--) {
-        sums->tag_table[sums->targets[i].t].l = i;
-    }
-
-    for (i = 0; i < sums->count; i++) {
-        sums->tag_table[sums->targets[i].t].r = i;
+        if (slot->i == 0) {
+            slot->weak_sum = b->weak_sum;
+            slot->strong_prefix = prefix;
+            slot->i = i + 1;
+        }
     }
 
     rs_trace("rs_build_hash_table done");
@@ -168,79 +134,46 @@ rs_search_for_block(rs_weak_sum_t weak_sum,
                     rs_long_t * match_where)
 {
     /* Caller must have called rs_build_hash_table() by now */
-    if (!sig->tag_table)
+    if (!sig->hashtable)
         rs_fatal("Must have called rs_build_hash_table() by now");
 
     rs_strong_sum_t strong_sum;
+    unsigned int prefix = 0;
     int got_strong = 0;
-    int hash_tag = gettag(weak_sum);
-    rs_tag_table_entry_t *bucket = &(sig->tag_table[hash_tag]);
-    int l = bucket->l; /* left bound of search region */
-    int r = bucket->r + 1; /* right bound of search region */
-    int v = 1; /* direction of next move: -ve left, +ve right */
-
-    if (l == NULL_TAG)
-        return 0;
-
-    while (l < r) {
-        int m = (l + r) >> 1; /* midpoint of search region */
-        int i = sig->targets[m].i;
-        rs_block_sig_t *b = &(sig->block_sigs[i]);
-        v = (weak_sum > b->weak_sum) - (weak_sum < b->weak_sum);
-        // v < 0  - weak_sum <  b->weak_sum
-        // v == 0 - weak_sum == b->weak_sum
-        // v > 0  - weak_sum >  b->weak_sum
-
-        if (v == 0) {
-            if (!got_strong) {
-                /* Lazy calculate strong sum after finding weak match. */
-                if(sig->magic == RS_BLAKE2_SIG_MAGIC) {
-                    rs_calc_blake2_sum(inbuf, block_len, &strong_sum);
-                } else if (sig->magic == RS_MD4_SIG_MAGIC) {
-                    rs_calc_md4_sum(inbuf, block_len, &strong_sum);
-                } else {
-                    /* Bad input data is checked in rs_delta_begin, so this
-                     * should never be reached. */
-                    rs_fatal("Unknown signature algorithm %#x", sig->magic);
-                    return 0;
-                }
-                got_strong = 1;
-            }
-            v = memcmp(strong_sum, b->strong_sum, sig->strong_sum_len);
+    unsigned int mask = (1U << sig->hashtable_bits) - 1;
+    unsigned int h = slot_of(weak_sum, sig->hashtable_bits);
+    rs_sig_slot_t const *slot;
 
-            if (v == 0) {
-                l = m;
-                r = m;
-                break;
-            }
-        }
-
-        if (v > 0)
-            l = m + 1;
-        else
-            r = m;
-    }
+    for (; (slot = &sig->hashtable[h])->i != 0; h = (h + 1) & mask) {
+        if (slot->weak_sum != weak_sum)
+            continue;
 
-    if ((l == r) && (l <= bucket->r)) {
-        int i = sig->targets[l].i;
-        rs_block_sig_t *b = &(sig->block_sigs[i]);
-        if (weak_sum != b->weak_sum)
-            return 0;
         if (!got_strong) {
-            if(sig->magic == RS_BLAKE2_SIG_MAGIC) {
+            /* Lazy calculate strong sum after finding weak match. */
+            if (sig->magic == RS_BLAKE2_SIG_MAGIC) {
                 rs_calc_blake2_sum(inbuf, block_len, &strong_sum);
             } else if (sig->magic == RS_MD4_SIG_MAGIC) {
                 rs_calc_md4_sum(inbuf, block_len, &strong_sum);
             } else {
-                rs_error("Unknown signature algorithm - this is a BUG");
-                return 0; /* FIXME: Is this the best way to handle this? */
+                /* Bad input data is checked in rs_delta_begin, so this
+                 * should never be reached. */
+                rs_fatal("Unknown signature algorithm %#x", sig->magic);
+                return 0;
             }
+            prefix = strong_prefix(sig, strong_sum);
             got_strong = 1;
         }
-        v = memcmp(strong_sum, b->strong_sum, sig->strong_sum_len);
-        int token = b->i;
-        *match_where = (rs_long_t)(token - 1) * sig->block_len;
+
+        if (slot->strong_prefix != prefix)
+            continue;
+
+        rs_block_sig_t const *b = &sig->block_sigs[slot->i - 1];
+
+        if (memcmp(strong_sum, b->strong_sum, sig->strong_sum_len) == 0) {
+            *match_where = (rs_long_t)(b->i - 1) * sig->block_len;
+            return 1;
+        }
     }
 
-    return !v;
+    return 0;
 }
@@ -38,11 +38,8 @@ rs_free_sumset(rs_signature_t * psums)
         if (psums->block_sigs)
                 free(psums->block_sigs);
 
-        if (psums->tag_table)
-		free(psums->tag_table);
-
-        if (psums->targets)
-                free(psums->targets);
+        if (psums->hashtable)
+                free(psums->hashtable);
 
         rs_bzero(psums, sizeof *psums);
         free(psums);
@@ -28,21 +28,20 @@
  */
 
 
-/**
- * \brief Description of the match described by a signature.
- */
-typedef struct rs_target {
-    unsigned short  t;
-    int             i;
-} rs_target_t;
-
 typedef struct rs_block_sig rs_block_sig_t;
 
-typedef struct rs_tag_table_entry {
-    int l; // left bound of the hash tag in sorted array of targets
-    int r; // right bound of the hash tag in sorted array of targets
-    // all tags between l and r inclusively are the same
-} rs_tag_table_entry_t ;
+/**
+ * \brief A slot of the open-addressing table that indexes the blocks of a
+ * signature by weak sum.
+ *
+ * The leading bytes of the strong sum are kept inline so that most weak sum
+ * collisions are rejected without touching the block signatures.
+ */
+typedef struct rs_sig_slot {
+    rs_weak_sum_t   weak_sum;
+    unsigned int    strong_prefix; /* first bytes of the strong sum */
+    int             i;             /* 1-based block index, 0 if unused */
+} rs_sig_slot_t;
 
 /*
  * This structure describes all the sums generated for an instance of
@@ -56,8 +55,8 @@ struct rs_signature {
     int             block_len;	/* block_length */
     int             strong_sum_len;
     rs_block_sig_t  *block_sigs; /* points to info for each chunk */
-    rs_tag_table_entry_t	*tag_table;
-    rs_target_t     *targets;
+    rs_sig_slot_t   *hashtable; /* built by rs_build_hash_table */
+    unsigned int    hashtable_bits; /* log2 of the number of slots */
     int             magic;
 };
 
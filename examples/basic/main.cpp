@@ -1,8 +1,12 @@
+#include "karazeh/caching_file_manager.hpp"
 #include "karazeh/patcher.hpp"
 #include "karazeh/path_resolver.hpp"
+#include "karazeh/release_planner.hpp"
 #include "karazeh/version_manifest.hpp"
 #include "karazeh/hashers/md5_hasher.hpp"
 #include <boost/filesystem.hpp>
+#include <cstdlib>
+#include <thread>
 
 namespace fs = boost::filesystem;
 using kzh::string_t;
@@ -17,6 +21,11 @@ int main(int argc, char** argv) {
 
   kzh::config_t config;
 
+  config.verbose = false;
+  config.concurrency = std::thread::hardware_concurrency();
+  config.stream_patches = false;
+  config.cache_digests = true;
+
   if (argc > 1) {
     for (int i = 0; i < argc; ++i) {
       string_t arg = argv[i];
@@ -30,6 +39,12 @@ int main(int argc, char** argv) {
       else if (arg == "-v") {
         config.verbose = true;
       }
+      else if (arg == "-j") {
+        config.concurrency = std::atoi(argv[++i]);
+      }
+      else if (arg == "-s") {
+        config.stream_patches = true;
+      }
     }
   }
 
@@ -72,8 +87,11 @@ int apply_updates(kzh::config_t &config) {
     config.host = "http://localhost:9393";
   }
 
+  // answer the repository's metadata queries from memory from here on
+  kzh::caching_file_manager cached_file_manager(file_manager, config.root_path, config.cache_path);
+
   config.hasher = &hasher;
-  config.file_manager = &file_manager;
+  config.file_manager = &cached_file_manager;
   config.downloader = &downloader;
 
   kzh::patcher patcher(config);
@@ -95,6 +113,8 @@ int apply_updates(kzh::config_t &config) {
   if (available_updates.size() > 0) {
     logger.info() << available_updates.size() << " updates are available.";
 
+    std::vector<kzh::release_manifest const*> releases;
+
     for (auto release_id : available_updates) {
       auto release = version_manifest.get_release(release_id);
 
@@ -102,8 +122,15 @@ int apply_updates(kzh::config_t &config) {
         version_manifest.load_release_from_uri(release->uri);
       }
 
+      releases.push_back(release);
+    }
+
+    // apply the net changes of consecutive releases in one go
+    kzh::release_planner planner(config);
+
+    for (auto release : planner.coalesce(releases)) {
       if (patcher.apply_update(*release) != kzh::STAGE_OK) {
-        logger.error() << "Update " << release << " could not be applied!";
+        logger.error() << "Update " << release->id << " could not be applied!";
         return 1;
       }
     }
@@ -0,0 +1,124 @@
+/**
+ * karazeh -- the library for patching software
+ *
+ * Copyright (C) 2011-2016 by Ahmad Amireh <ahmad@amireh.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef H_KARAZEH_CACHING_FILE_MANAGER_H
+#define H_KARAZEH_CACHING_FILE_MANAGER_H
+
+#include <map>
+#include <mutex>
+#include "karazeh_export.h"
+#include "karazeh/karazeh.hpp"
+#include "karazeh/file_manager.hpp"
+
+namespace kzh {
+
+  /**
+   * @class caching_file_manager
+   * @brief
+   * Answers metadata queries about the application's files from memory.
+   *
+   * The tree under the root path is walked once up-front, after which
+   * exists(), is_readable(), is_writable(), is_directory(), and
+   * stat_filesize() no longer have to go to the filesystem for every query;
+   * permissions and sizes are looked up on first use and remembered.
+   *
+   * Changes made through the file_manager (moving, removing, creating
+   * directories) update the cache. Anything else that modifies the tree must
+   * be followed by a call to refresh(). Paths outside of the root, or inside
+   * the excluded path (the Karazeh cache), are not cached at all.
+   *
+   * All other calls are forwarded to the wrapped file_manager. It is safe to
+   * use from multiple threads at once.
+   */
+  class KARAZEH_EXPORT caching_file_manager : public file_manager {
+  public:
+    /**
+     * @param inner
+     *        The file_manager to forward to. Must outlive the cache.
+     *
+     * @param root
+     *        The tree to cache, usually config_t::root_path.
+     *
+     * @param excluded
+     *        A directory inside of the root that should not be cached, usually
+     *        config_t::cache_path.
+     */
+    caching_file_manager(file_manager const& inner, path_t const& root, path_t const& excluded);
+    virtual ~caching_file_manager();
+
+    /** Discards everything that's cached and walks the tree again. */
+    void refresh() const;
+
+    virtual bool load_file(std::ifstream &fs, string_t& out_buf) const;
+    virtual bool load_file(string_t const& path, string_t& out_buf) const;
+    virtual bool load_file(path_t const& path, string_t& out_buf) const;
+
+    virtual bool remove_file(path_t const&) const;
+    virtual bool remove_directory(path_t const&) const;
+
+    virtual bool exists(path_t const&) const;
+
+    virtual bool is_empty(path_t const&) const;
+    virtual bool is_directory(path_t const&) const;
+
+    virtual bool is_readable(path_t const &path) const;
+    virtual bool is_readable(string_t const &path) const;
+
+    virtual bool is_writable(path_t const &path) const;
+    virtual bool is_writable(string_t const &path) const;
+
+    virtual bool move(path_t const&, path_t const&) const;
+
+    virtual bool create_directory(path_t const& path) const;
+    virtual bool ensure_directory(path_t const& path) const;
+
+    virtual bool make_executable(path_t const&) const;
+
+    virtual uint64_t stat_filesize(path_t const&) const;
+    virtual uint64_t stat_filesize(std::ifstream&) const;
+
+    virtual std::unique_ptr<mapped_file> map_file(path_t const&) const;
+
+  private:
+    /** What we know of a path that exists; -1 stands for "not looked up yet" */
+    struct entry_t {
+      bool      directory;
+      int       readable;
+      int       writable;
+      bool      sized;
+      uint64_t  size;
+    };
+
+    file_manager const& inner_;
+    const string_t root_;
+    const string_t excluded_;
+
+    mutable std::mutex mutex_;
+    mutable std::map<string_t, entry_t> entries_;
+
+    bool is_cached(string_t const& key) const;
+    void invalidate(path_t const&) const;
+    void scan(string_t const& key) const;
+    void scan_directory(path_t const&) const;
+  };
+
+} // end of namespace kzh
+
+#endif
@@ -0,0 +1,102 @@
+/**
+ * karazeh -- the library for patching software
+ *
+ * Copyright (C) 2011-2016 by Ahmad Amireh <ahmad@amireh.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#ifndef H_KARAZEH_CDC_ENCODER_H
+#define H_KARAZEH_CDC_ENCODER_H
+
+#include "karazeh_export.h"
+#include "karazeh/karazeh.hpp"
+#include "karazeh/delta_codec.hpp"
+#include "karazeh/logger.hpp"
+
+namespace kzh {
+
+  /**
+   * @class cdc_encoder
+   * @brief
+   * Delta encoding over content-defined chunks, registered as the "cdc" codec.
+   *
+   * Files are cut into chunks where a gear hash of the last few bytes hits a
+   * pattern (FastCDC's normalized chunking), so chunk boundaries move along
+   * with the content and an insertion only disturbs the chunks around it,
+   * where librsync's fixed blocks can lose every match after it.
+   *
+   * The signature of a basis is the length and 128-bit XXH3 digest of each of
+   * its chunks. A delta is the new file's chunks, each either copied from the
+   * basis by offset or shipped as a literal. Chunks are digested on up to
+   * @concurrency threads.
+   *
+   * Signature and delta formats, all integers big-endian:
+   *
+   *   signature := MAGIC MIN_SIZE AVERAGE_SIZE MAX_SIZE { LENGTH DIGEST }
+   *   delta     := MAGIC { COPY OFFSET LENGTH | LITERAL LENGTH BYTES } END
+   *
+   * where sizes and chunk lengths are 32-bit, offsets and command lengths are
+   * 64-bit, digests are 16 bytes, and commands are a single byte.
+   */
+  class KARAZEH_EXPORT cdc_encoder : public delta_codec, public logger
+  {
+  public:
+    /** chunk size the chunker aims for, in bytes */
+    static const size_t DEFAULT_AVERAGE_CHUNK_SIZE = 8 * 1024;
+
+    /**
+     * @param average_chunk_size
+     *        A power of two; chunks are between a quarter and 8 times that.
+     *        Only affects signatures, deltas are cut the way their signature
+     *        says.
+     *
+     * @param concurrency
+     *        The number of threads to digest chunks on.
+     *
+     * @throw kzh::invalid_state if the chunk size isn't a power of two between
+     *        256 bytes and 1 MiB
+     */
+    explicit cdc_encoder(
+      size_t average_chunk_size = DEFAULT_AVERAGE_CHUNK_SIZE,
+      int concurrency = 1);
+
+    virtual ~cdc_encoder();
+
+    /**
+     * @return RS_IO_ERROR if the basis can't be read
+     */
+    virtual rs_result signature(std::istream& basis, std::ostream& signature) const;
+
+    /**
+     * @return RS_BAD_MAGIC or RS_CORRUPT if the signature is not one of ours,
+     *         or RS_IO_ERROR if either of the inputs can't be read
+     */
+    virtual rs_result delta(std::istream& signature, std::istream& new_file, std::ostream& delta) const;
+
+    /**
+     * The patch fails with RS_BAD_MAGIC or RS_CORRUPT on malformed deltas,
+     * RS_INPUT_ENDED on truncated ones, and RS_IO_ERROR if the target can't be
+     * written.
+     */
+    virtual std::unique_ptr<context> begin_patch(char const* basis, size_t basis_size, std::ostream& target) const;
+
+  private:
+    size_t average_chunk_size_;
+    int concurrency_;
+  };
+
+} // end of namespace kzh
+
+#endif
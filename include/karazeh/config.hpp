@@ -37,6 +37,28 @@ namespace kzh {
     kzh::downloader const* downloader;
     kzh::file_manager const* file_manager;
     bool verbose;
+
+    /**
+     * The maximum number of threads to use for work that can be carried out
+     * in parallel, like staging the operations of a release. Values lower
+     * than 2 keep all the work on the calling thread.
+     */
+    int concurrency = 1;
+
+    /**
+     * When set, update operations apply deltas while they are being
+     * downloaded instead of saving them to the cache and reading them back
+     * when deploying.
+     */
+    bool stream_patches = false;
+
+    /**
+     * When set, the digests of identity files are remembered across runs in a
+     * digest_cache under cache_path, and only calculated again once the files
+     * change. The patcher keeps the cache up to date with the files it
+     * deploys.
+     */
+    bool cache_digests = false;
   } config_t;
 
 } // end of namespace kzh
@@ -0,0 +1,167 @@
+/**
+ * karazeh -- the library for patching software
+ *
+ * Copyright (C) 2011-2016 by Ahmad Amireh <ahmad@amireh.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#ifndef H_KARAZEH_DELTA_CODEC_H
+#define H_KARAZEH_DELTA_CODEC_H
+
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <streambuf>
+#include "karazeh_export.h"
+#include "karazeh/karazeh.hpp"
+
+extern "C" {
+  #include "librsync-2.0.0/src/librsync.h"
+}
+
+namespace kzh {
+
+  /**
+   * @class delta_codec
+   * @brief
+   * A delta encoding: how a basis is summed up in a signature, how the delta
+   * of a new file is generated from that signature, and how a delta is applied
+   * on its basis.
+   *
+   * Codecs hold no state and are shared, see find(). Every codec reports its
+   * status as an rs_result so that callers handle them all the same way.
+   */
+  class KARAZEH_EXPORT delta_codec
+  {
+  public:
+    inline delta_codec(string_t const& name) : name_(name) { };
+    inline virtual ~delta_codec() {};
+
+    /**
+     * A patch that is applied incrementally as its delta becomes available,
+     * see delta_codec::begin_patch().
+     */
+    class context {
+    public:
+      inline virtual ~context() {};
+
+      /**
+       * Feeds the next chunk of the delta to the patch.
+       *
+       * @return false if the patch has failed, finish() tells why
+       */
+      virtual bool update(char const* data, size_t size) = 0;
+
+      /**
+       * Signals the end of the delta and writes out what's left of the patched
+       * file.
+       *
+       * @return the status of the patch
+       */
+      virtual rs_result finish() = 0;
+    };
+
+    /**
+     * Generates the signature of a basis, read from a stream in blocks.
+     */
+    virtual rs_result signature(std::istream& basis, std::ostream& signature) const = 0;
+
+    /**
+     * Generates the delta of a new file against the signature of its basis.
+     */
+    virtual rs_result delta(std::istream& signature, std::istream& new_file, std::ostream& delta) const = 0;
+
+    /**
+     * Starts applying a delta on a basis that is in memory. The patched file is
+     * written out to @target as the delta is fed to the context.
+     */
+    virtual std::unique_ptr<context> begin_patch(char const* basis, size_t basis_size, std::ostream& target) const = 0;
+
+    /**
+     * Applies a delta read from a stream on a basis that is in memory, built
+     * on begin_patch().
+     */
+    virtual rs_result patch(char const* basis, size_t basis_size, std::istream& delta, std::ostream& target) const;
+
+    /**
+     * Applies a delta on a basis and stores the result at @target. Both files
+     * are memory-mapped, see file_manager::map_file().
+     *
+     * @return RS_IO_ERROR if either file can't be mapped or the target can't
+     *         be written, otherwise the status of the patch
+     */
+    virtual rs_result patch(path_t const& basis, path_t const& delta, path_t const& target) const;
+
+    /**
+     * Looks up one of the codecs shipped with Karazeh by name: "rsync" for
+     * librsync's fixed-block deltas (see delta_encoder), and "cdc" for deltas
+     * built from content-defined chunks (see cdc_encoder).
+     *
+     * The shared codecs work on the calling thread; build a cdc_encoder of
+     * your own to digest chunks on more.
+     *
+     * @return nullptr if there is no such codec
+     */
+    static delta_codec const* find(string_t const& name);
+
+    inline string_t const& name() const {
+      return name_;
+    };
+
+  protected:
+    string_t name_;
+  };
+
+  /**
+   * @class patch_stream
+   * @brief
+   * An output stream that patches an in-memory basis with the delta written
+   * to it, as it is written, so that a delta can be applied while it is still
+   * being downloaded.
+   *
+   * The patched file is written out to the target stream. Once the whole
+   * delta has been written, finish() must be called to complete the patch.
+   */
+  class KARAZEH_EXPORT patch_stream : public std::ostream
+  {
+  public:
+    /** patches using librsync, see delta_encoder */
+    patch_stream(char const* basis, size_t basis_size, std::ostream& target);
+
+    /** patches using whichever codec started @patch */
+    explicit patch_stream(std::unique_ptr<delta_codec::context> patch);
+
+    virtual ~patch_stream();
+
+    patch_stream(const patch_stream&) = delete;
+    patch_stream& operator=(const patch_stream&) = delete;
+
+    /**
+     * Signals the end of the delta and writes out what's left of the patched
+     * file.
+     *
+     * @return the status of the patch
+     */
+    rs_result finish();
+
+  private:
+    class patch_buffer;
+
+    std::unique_ptr<patch_buffer> buffer_;
+  };
+
+} // end of namespace kzh
+
+#endif
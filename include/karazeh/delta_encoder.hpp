@@ -21,8 +21,12 @@
 #ifndef H_KARAZEH_DELTA_ENCODER_H
 #define H_KARAZEH_DELTA_ENCODER_H
 
+#include <istream>
+#include <memory>
+#include <ostream>
 #include "karazeh_export.h"
 #include "karazeh/karazeh.hpp"
+#include "karazeh/delta_codec.hpp"
 #include "karazeh/logger.hpp"
 #include "karazeh/file_manager.hpp"
 
@@ -33,12 +37,40 @@ extern "C" {
 
 namespace kzh {
 
+  /** The parameters a librsync signature is generated with */
+  struct KARAZEH_EXPORT signature_options_t {
+    inline signature_options_t()
+    : block_length(RS_DEFAULT_BLOCK_LEN),
+      strong_length(RS_MAX_STRONG_SUM_LENGTH)
+    {}
+
+    inline signature_options_t(size_t in_block_length, size_t in_strong_length)
+    : block_length(in_block_length),
+      strong_length(in_strong_length)
+    {}
+
+    /**
+     * Picks the block length for a basis of the given size: the square root
+     * of the size rounded up to a multiple of 128 bytes, but no less than
+     * RS_DEFAULT_BLOCK_LEN. This keeps the number of blocks, and so the size
+     * of the signature and its hash table, in check for very large files.
+     */
+    static signature_options_t for_size(uint64_t size);
+
+    /** Size of the blocks the basis is matched in */
+    size_t block_length;
+
+    /** Bytes of the strong checksum kept for every block, up to RS_MAX_STRONG_SUM_LENGTH */
+    size_t strong_length;
+  };
+
   /**
    * @class delta_encoder
    * @brief
-   * librsync implementation of delta encoding, used in rdiff.
+   * librsync implementation of delta encoding, used in rdiff. Registered as
+   * the "rsync" codec.
    */
-  class KARAZEH_EXPORT delta_encoder : public logger
+  class KARAZEH_EXPORT delta_encoder : public delta_codec, public logger
   {
   public:
 
@@ -50,13 +82,17 @@ namespace kzh {
      *
      * @param basis path to the file you want to generate the signature for
      * @param signature path to where the signature file should be stored
+     * @param options block and strong sum lengths to use, picked by
+     *        signature_options_t::for_size() based on the basis if omitted
      *
      * @return the status of rs_sig_file() (@see man rdiff)
      *
      * @throw kzh::invalid_resource if basis does not exist or is unreadable
      * @throw kzh::invalid_state if signature is not writable
+     * @throw kzh::invalid_state if the options are out of range
      */
-    rs_result signature(path_t const& basis, path_t const& signature);
+    rs_result signature(path_t const& basis, path_t const& signature) const;
+    rs_result signature(path_t const& basis, path_t const& signature, signature_options_t const& options) const;
 
     /**
      * Generates a delta patch based on the given signature and the new file.
@@ -71,11 +107,31 @@ namespace kzh {
      * @throw kzh::invalid_resource if delta does not exist or is unreadable
      * @throw kzh::invalid_state if target destination is unwritable
      */
-    rs_result delta(path_t const& signature, path_t const& new_file, path_t const& delta);
+    rs_result delta(path_t const& signature, path_t const& new_file, path_t const& delta) const;
+
+    /**
+     * Parallel variant of delta() for large files, see the in-memory overload
+     * below. The new file is memory-mapped; if it can't be, the delta is
+     * generated on the calling thread instead.
+     *
+     * @param concurrency the number of threads to search the new file on
+     *
+     * @throw kzh::invalid_resource if the signature or the new file is unreadable
+     * @throw kzh::invalid_state if target destination is unwritable
+     */
+    rs_result delta(
+      path_t const& signature,
+      path_t const& new_file,
+      path_t const& delta,
+      int concurrency) const;
 
     /**
      * Applies a patch on the basis file and stores it somewhere else.
      *
+     * The basis and the delta are memory-mapped when possible, so that the
+     * parts of the basis the delta refers to are copied straight out of the
+     * mapping.
+     *
      * @param basis the base file to patch
      * @param delta the delta to patch the basis with, generatable using delta()
      * @param target the destination where the patched file will be stored
@@ -86,7 +142,84 @@ namespace kzh {
      * @throw kzh::invalid_resource if delta does not exist or is unreadable
      * @throw kzh::invalid_state if target destination is unwritable
      */
-    rs_result patch(path_t const& basis, path_t const& delta, path_t const& target);
+    virtual rs_result patch(path_t const& basis, path_t const& delta, path_t const& target) const;
+
+    /**
+     * Applies a patch using a basis and a delta that have already been mapped
+     * into memory.
+     *
+     * @return the status of the librsync patch job
+     */
+    rs_result patch(mapped_file const& basis, mapped_file const& delta, path_t const& target) const;
+
+    /**
+     * Streaming variant of signature(), the basis is read in blocks and the
+     * signature written out as it's generated. The default options are used
+     * unless given.
+     *
+     * @return the status of the librsync signature job
+     */
+    virtual rs_result signature(std::istream& basis, std::ostream& signature) const;
+    rs_result signature(
+      std::istream& basis,
+      std::ostream& signature,
+      signature_options_t const& options) const;
+
+    /**
+     * Streaming variant of delta(); the signature is loaded first, then the
+     * new file is read in blocks and the delta written out as it's generated.
+     *
+     * @return the status of the librsync loadsig or delta job, whichever failed
+     */
+    virtual rs_result delta(std::istream& signature, std::istream& new_file, std::ostream& delta) const;
+
+    /**
+     * Generates the delta of a new file that is in memory on several threads.
+     *
+     * The new file is split into regions of at least 64 MiB, aligned to the
+     * signature's block length, which are searched against the signature
+     * independently. The command streams of the regions are then stitched
+     * into a single delta: all but the first lose their header, and all but
+     * the last their end command. Since a match can't straddle two regions,
+     * the delta may be a few blocks larger than the one generated in one go.
+     *
+     * Regions are encoded @concurrency at a time and written out in between,
+     * so no more than that many region deltas are held in memory.
+     *
+     * @return the status of the librsync loadsig job, or of the first delta
+     *         job that failed
+     */
+    rs_result delta(
+      std::istream& signature,
+      char const* new_file,
+      size_t new_file_size,
+      std::ostream& delta,
+      int concurrency) const;
+
+    /**
+     * Applies a delta read from a stream on a basis that is in memory, writing
+     * the patched file out to @target.
+     *
+     * @return the status of the librsync patch job
+     */
+    virtual rs_result patch(char const* basis, size_t basis_size, std::istream& delta, std::ostream& target) const;
+
+    /**
+     * Applies a delta on a basis where both are in memory.
+     *
+     * @return the status of the librsync patch job
+     */
+    rs_result patch(
+      char const* basis,
+      size_t basis_size,
+      char const* delta,
+      size_t delta_size,
+      std::ostream& target) const;
+
+    /**
+     * Starts an rs_patch job on a basis that is in memory.
+     */
+    virtual std::unique_ptr<context> begin_patch(char const* basis, size_t basis_size, std::ostream& target) const;
 
   protected:
     /// used for validating paths and file permissions
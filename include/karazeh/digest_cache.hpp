@@ -0,0 +1,113 @@
+/**
+ * karazeh -- the library for patching software
+ *
+ * Copyright (C) 2011-2016 by Ahmad Amireh <ahmad@amireh.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#ifndef H_KARAZEH_DIGEST_CACHE_H
+#define H_KARAZEH_DIGEST_CACHE_H
+
+#include <map>
+#include <mutex>
+#include "karazeh_export.h"
+#include "karazeh/karazeh.hpp"
+#include "karazeh/hasher.hpp"
+#include "karazeh/logger.hpp"
+
+namespace kzh {
+
+  /**
+   * @class digest_cache
+   * @brief
+   * Remembers the digests of files across runs so that files which haven't
+   * changed since they were last digested don't have to be read again.
+   *
+   * Every entry is keyed on the path of the file and the hasher, and is only
+   * trusted while the size, modification time (to the nanosecond where the
+   * platform has it), and inode of the file are the same as when it was
+   * digested.
+   *
+   * The entries are kept in a single file that is read by load() and written
+   * by save(); a missing or malformed file counts as an empty cache. It is safe
+   * to use from several threads at once.
+   */
+  class KARAZEH_EXPORT digest_cache : protected logger {
+  public:
+    /** Name of the cache file under config_t::cache_path */
+    static const char* const FILE_NAME;
+
+    explicit digest_cache(path_t const& path);
+    virtual ~digest_cache();
+
+    /**
+     * Reads the cache file, replacing the entries in memory.
+     *
+     * @return false if the file is missing or malformed, the cache is empty
+     *         then
+     */
+    bool load();
+
+    /**
+     * Writes the cache file out if any entry changed since it was loaded. The
+     * file is written next to the old one and moved over it.
+     *
+     * @return false if the file could not be written
+     */
+    bool save();
+
+    /**
+     * The digest of a file: the cached one if the file hasn't changed since,
+     * otherwise calculated by @hasher and cached.
+     */
+    hasher::digest_rc hex_digest(hasher const&, path_t const&);
+
+    /**
+     * Updates the entry of a file that was just replaced with a known digest,
+     * like a patched file whose checksum has been verified, so that it isn't
+     * digested again. Files the cache knows nothing of are left out.
+     */
+    void refresh(hasher const&, path_t const&, string_t const& digest);
+
+    /**
+     * Forgets the digest of a file, for when it was removed. A later refresh
+     * of the same path, like when a release deletes a file and then creates
+     * it again, still takes.
+     */
+    void remove(path_t const&);
+
+  private:
+    struct entry_t {
+      uint64_t size;
+      uint64_t mtime;
+      uint64_t inode;
+      string_t digest;
+    };
+
+    /** @return false if the file can't be stat'd */
+    static bool stat(path_t const&, entry_t&);
+
+    /** entries are keyed on the hasher name and the normalized path */
+    static string_t key_of(hasher const&, path_t const&);
+
+    const path_t path_;
+    std::map<string_t, entry_t> entries_;
+    std::mutex mutex_;
+    bool dirty_;
+  };
+
+} // end of namespace kzh
+
+#endif
@@ -21,6 +21,8 @@
 #ifndef H_KARAZEH_DOWNLOADER_H
 #define H_KARAZEH_DOWNLOADER_H
 
+#include <functional>
+#include <vector>
 #include <curl/curl.h>
 #include <boost/filesystem.hpp>
 #include "binreloc/binreloc.h"
@@ -33,16 +35,58 @@
 
 namespace kzh {
   struct download_t;
+  struct async_download_t;
+  struct connection_pool;
 
+  /** A file to be downloaded and verified, see downloader::fetch_async() */
+  struct KARAZEH_EXPORT download_job_t {
+    inline download_job_t() : hasher(nullptr) {}
+
+    /** URI of the file, relative to config_t::host unless it's a full URL */
+    url_t     url;
+
+    /** Where the file should be stored */
+    path_t    path;
+
+    /** The checksum the downloaded file must match */
+    string_t  checksum;
+
+    /** The hasher the checksum was calculated with, defaults to config_t::hasher */
+    kzh::hasher const* hasher;
+  };
+
+  /**
+   * Fetches remote resources over HTTP using libcurl.
+   *
+   * CURL handles are pooled and kept around between transfers, and they share
+   * their DNS, TLS session, and connection caches, so consecutive downloads from
+   * the same host reuse connections instead of going through a new handshake
+   * for every file. It is safe to fetch from multiple threads at once.
+   *
+   * A downloader must be destroyed before curl_global_cleanup() is called.
+   */
   class KARAZEH_EXPORT downloader : protected logger {
   public:
+    /**
+     * Invoked once an asynchronous download is done, with whether the file
+     * was downloaded and its integrity verified.
+     */
+    typedef std::function<void(download_job_t const&, bool)> async_callback_t;
+
     downloader(config_t const&, file_manager const&);
     virtual ~downloader();
 
+    downloader(const downloader&) = delete;
+    downloader& operator=(const downloader&) = delete;
+
     /** The number of times to retry a download */
     int retry_count() const;
     void set_retry_count(int);
 
+    /** The number of asynchronous downloads to carry out at the same time */
+    int max_async_transfers() const;
+    void set_max_async_transfers(int);
+
     /**
      * Downloads the file found at URI and stores it in out_buf. If
      * @URI does not start with http:// then it will be prefixed by
@@ -60,33 +104,124 @@ namespace kzh {
      * its integrity against the given checksum. The download
      * will be retried up to retry_count() times.
      *
+     * The checksum is calculated as the file is being received instead of
+     * reading it back from disk.
+     *
+     * When a transfer is interrupted, the retry picks up where it left off
+     * using an HTTP range request instead of starting over. The tail of what
+     * was already received is requested again and compared against the local
+     * copy; if they differ, or the server does not support ranges, the file
+     * is downloaded from scratch.
+     *
+     * @param hasher
+     *        The hasher the checksum was calculated with, config_t::hasher is
+     *        used if none is given.
+     *
      * Returns true if the file was downloaded and its integrity verified.
      */
     virtual bool fetch(
       url_t const& URI,
       path_t const& path_to_file,
       string_t const& checksum,
-      int* const retry_tally = NULL
+      int* const retry_tally = NULL,
+      hasher const* hasher = NULL
+    ) const;
+
+    /**
+     * Downloads the file found at the given URI into a stream and verifies its
+     * integrity against the given checksum as it is received.
+     *
+     * Since whatever was written to the stream can't be taken back, the
+     * download is neither retried nor resumed; that's up to the caller.
+     *
+     * Returns true if the file was downloaded and its integrity verified.
+     */
+    virtual bool fetch(
+      url_t const& URI,
+      std::ostream& out_stream,
+      string_t const& checksum,
+      hasher const* hasher = NULL
     ) const;
 
+    /**
+     * Queues a download to be carried out without blocking the caller. The
+     * job is downloaded and verified just like the checksum overload of
+     * fetch() does, including the retries.
+     *
+     * Transfers only make progress while perform() or wait() is called;
+     * queued downloads run on a single curl_multi handle, up to
+     * max_async_transfers() of them at a time.
+     *
+     * @param callback
+     *        Invoked from within perform() once the download is done.
+     */
+    virtual void fetch_async(download_job_t const& job, async_callback_t const& callback) const;
+
+    /**
+     * Drives the queued downloads. Waits up to timeout_ms milliseconds for
+     * network activity if there's nothing to do right away.
+     *
+     * @return the number of downloads still pending
+     */
+    virtual size_t perform(int timeout_ms = 0) const;
+
+    /** Drives the queued downloads until all of them are done. */
+    virtual void wait() const;
+
   private:
     const config_t &config_;
     const file_manager& file_manager_;
 
     url_t get_full_url(string_t const&) const;
     bool fetch_file(url_t const&, download_t*, bool assume_ownership) const;
+    bool verify_response(CURL*, CURLcode, char const* curlerr) const;
+    bool verify_integrity(path_t const&, string_t const& checksum, hasher::context*) const;
+    void start_async_transfers(std::vector<async_download_t*>& failed) const;
 
     int retry_count_;
+    int max_async_transfers_;
+    connection_pool *connections_;
   };
 
   /** Used internally by the downloader to manage downloads */
   struct KARAZEH_EXPORT download_t {
     inline explicit
-    download_t(string_t const& in_url) : url(in_url), buf(nullptr), stream(nullptr) {}
+    download_t(string_t const& in_url)
+    : buf(nullptr),
+      stream(nullptr),
+      url(in_url),
+      digest(nullptr),
+      range_start(0),
+      overlap_mismatch(false),
+      received(0),
+      curlrc(CURLE_OK)
+    {}
+
+    string_t          *buf;
+    std::ostream      *stream;
+    string_t          url;
+
+    /** When set, the received data is fed to it as it arrives */
+    hasher::context   *digest;
+
+    /** Offset of the first byte to request, 0 fetches the whole resource */
+    uint64_t          range_start;
+
+    /**
+     * Bytes the response is expected to start with; they are verified and
+     * skipped rather than written. Used to check a resumed download against
+     * the data that was already received.
+     */
+    string_t          overlap;
+
+    /** Set if the response did not match the overlap, aborting the transfer */
+    bool              overlap_mismatch;
+
+    /** Number of bytes written, not counting the overlap */
+    uint64_t          received;
 
-    string_t      *buf;
-    std::ostream  *stream;
-    string_t      url;
+    /** The result of the transfer */
+    CURLcode          curlrc;
   };
 } // end of namespace kzh
 
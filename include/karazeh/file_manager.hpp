@@ -21,6 +21,8 @@
 #ifndef H_KARAZEH_FILE_MANAGER_H
 #define H_KARAZEH_FILE_MANAGER_H
 
+#include <memory>
+#include <vector>
 #include <curl/curl.h>
 #include <boost/filesystem.hpp>
 #include "binreloc/binreloc.h"
@@ -30,16 +32,69 @@
 #include "karazeh/hasher.hpp"
 
 namespace kzh {
+  /**
+   * A read-only view of the content of a file, see file_manager::map_file().
+   *
+   * On POSIX systems the file is memory-mapped, so it can be read without
+   * being copied into user-space buffers first, and the kernel is advised that
+   * it will be read sequentially. Elsewhere, the file is loaded into memory.
+   *
+   * The file must not be truncated while it is mapped.
+   */
+  class KARAZEH_EXPORT mapped_file {
+  public:
+    /**
+     * @return nullptr if the file could not be opened or mapped, for example
+     * when it is too large for the address space.
+     */
+    static std::unique_ptr<mapped_file> open(path_t const&);
+
+    ~mapped_file();
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    /** The content of the file; nullptr if the file is empty */
+    char const* data() const;
+
+    size_t size() const;
+
+  private:
+    mapped_file();
+
+    char const* data_;
+    size_t size_;
+    bool mapped_;
+    std::vector<char> buffer_;
+  };
+
   class KARAZEH_EXPORT file_manager : public logger {
   public:
 
     file_manager();
     virtual ~file_manager();
 
-    /** Loads the content of a file stream into memory */
+    /**
+     * Lexically normalizes a path so that the different spellings the patcher
+     * uses for the same file ("root/./a", "root/b/../a") compare equal. The
+     * file system isn't consulted.
+     */
+    static path_t normalize(path_t const&);
+
+    /**
+     * Loads the rest of a file stream into memory, appending it to out_buf.
+     *
+     * Returns false if the stream isn't open or could not be read.
+     */
     virtual bool load_file(std::ifstream &fs, string_t& out_buf) const;
 
-    /** Loads the content of a file found at @path into memory */
+    /**
+     * Loads the content of a file found at @path into memory, appending it to
+     * out_buf.
+     *
+     * Callers that only need to read the content can use map_file() instead,
+     * which does not copy it.
+     */
     virtual bool load_file(string_t const& path, string_t& out_buf) const;
     virtual bool load_file(path_t const& path, string_t& out_buf) const;
 
@@ -82,6 +137,13 @@ namespace kzh {
 
     virtual uint64_t stat_filesize(path_t const&) const;
     virtual uint64_t stat_filesize(std::ifstream&) const;
+
+    /**
+     * Maps the content of a file into memory for reading, see mapped_file.
+     *
+     * @return nullptr if the file could not be mapped.
+     */
+    virtual std::unique_ptr<mapped_file> map_file(path_t const&) const;
   };
 
 } // end of namespace kzh
@@ -21,6 +21,7 @@
 #ifndef H_KARAZEH_HASHER_H
 #define H_KARAZEH_HASHER_H
 
+#include <memory>
 #include "karazeh_export.h"
 #include "karazeh/karazeh.hpp"
 
@@ -55,12 +56,45 @@ namespace kzh {
       }
     };
 
+    /**
+     * A digest that is calculated incrementally as the input becomes
+     * available, see hasher::begin().
+     */
+    class context {
+    public:
+      inline virtual ~context() {};
+
+      /** feeds the next chunk of input to the digest */
+      virtual void update(const char* data, size_t length) = 0;
+
+      /** calculates the digest of all the input fed so far */
+      virtual digest_rc finalize() = 0;
+    };
+
+    /**
+     * Starts an incremental digest calculation, for when the input isn't
+     * available all at once, like while it's being downloaded.
+     *
+     * This is the only thing a hasher has to implement; the hex_digest()
+     * overloads are built on top of it.
+     */
+    virtual std::unique_ptr<context> begin() const = 0;
+
     /** digests can be calculated directly off raw data */
-    virtual digest_rc hex_digest(string_t const& data) const = 0;
+    virtual digest_rc hex_digest(string_t const& data) const;
 
     /** digests can be calculated off data in a _valid_ file stream */
-    virtual digest_rc hex_digest(std::ifstream& src) const = 0;
-    virtual digest_rc hex_digest(path_t const& path) const = 0;
+    virtual digest_rc hex_digest(std::ifstream& src) const;
+    virtual digest_rc hex_digest(path_t const& path) const;
+
+    /**
+     * Looks up one of the hashers shipped with Karazeh by name, such as "MD5"
+     * or "XXH3". Tree hashing variants of those (see tree_hasher) are named
+     * "MD5-TREE" and "XXH3-TREE".
+     *
+     * @return nullptr if there is no such hasher
+     */
+    static hasher const* find(string_t const& name);
 
     inline string_t const& name() const {
       return name_;
@@ -34,9 +34,7 @@ namespace kzh {
     inline md5_hasher() : hasher("MD5") { }
     inline virtual ~md5_hasher() { }
 
-    virtual digest_rc hex_digest(string_t const& data) const;
-    virtual digest_rc hex_digest(std::ifstream& src) const;
-    virtual digest_rc hex_digest(path_t const& path) const;
+    virtual std::unique_ptr<context> begin() const;
   };
 
 } // end of namespace kzh
@@ -0,0 +1,77 @@
+/**
+ * karazeh -- the library for patching software
+ *
+ * Copyright (C) 2011-2016 by Ahmad Amireh <ahmad@amireh.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef H_KARAZEH_HASHER_TREE_H
+#define H_KARAZEH_HASHER_TREE_H
+
+#include "karazeh_export.h"
+#include "karazeh/hasher.hpp"
+
+namespace kzh {
+
+  /**
+   * Calculates a two-level hash tree over another hasher so that the chunks
+   * of a large file can be digested in parallel.
+   *
+   * The input is split into chunks of chunk_size() bytes, the last one being
+   * shorter (or empty, for empty input), and every chunk is digested using the
+   * leaf hasher. The root digest is the leaf hasher's digest of all the chunk
+   * digests joined together, in order.
+   *
+   * Files given by path are read and digested by up to concurrency() threads.
+   * Any other input is digested in order on the calling thread, which yields
+   * the same digest.
+   */
+  class KARAZEH_EXPORT tree_hasher : public hasher
+  {
+    public:
+
+    /** 4 MiB */
+    static const uint64_t DEFAULT_CHUNK_SIZE = 4 * 1024 * 1024;
+
+    /**
+     * @param leaf
+     *        The hasher to digest the chunks and the root with. Must outlive
+     *        the tree hasher.
+     *
+     * @param concurrency
+     *        The number of threads to digest files with, see worker_pool.
+     */
+    tree_hasher(hasher const& leaf, uint64_t chunk_size, int concurrency);
+    inline virtual ~tree_hasher() { }
+
+    virtual std::unique_ptr<context> begin() const;
+
+    virtual digest_rc hex_digest(path_t const& path) const;
+
+    using hasher::hex_digest;
+
+    uint64_t chunk_size() const;
+    int concurrency() const;
+
+  private:
+    hasher const& leaf_;
+    uint64_t chunk_size_;
+    int concurrency_;
+  };
+
+} // end of namespace kzh
+
+#endif
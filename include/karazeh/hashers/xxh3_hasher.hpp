@@ -0,0 +1,50 @@
+/**
+ * karazeh -- the library for patching software
+ *
+ * Copyright (C) 2011-2016 by Ahmad Amireh <ahmad@amireh.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef H_KARAZEH_HASHER_XXH3_H
+#define H_KARAZEH_HASHER_XXH3_H
+
+#include "karazeh_export.h"
+#include "karazeh/hasher.hpp"
+
+namespace kzh {
+
+  /**
+   * A fast, non-cryptographic hasher producing 128-bit XXH3 digests.
+   *
+   * On x86-64 the widest SIMD kernel the CPU supports (AVX-512, AVX2, or
+   * SSE2) is picked at runtime.
+   */
+  class KARAZEH_EXPORT xxh3_hasher : public hasher
+  {
+    public:
+
+    inline xxh3_hasher() : hasher("XXH3") { }
+    inline virtual ~xxh3_hasher() { }
+
+    virtual std::unique_ptr<context> begin() const;
+
+    /** the name of the SIMD kernel in use, like "avx2" */
+    static char const* kernel();
+  };
+
+} // end of namespace kzh
+
+#endif
@@ -21,6 +21,7 @@
 #ifndef H_KARAZEH_LOGGER_H
 #define H_KARAZEH_LOGGER_H
 
+#include <atomic>
 #include <sstream>
 #include <fstream>
 #include <iostream>
@@ -107,31 +108,42 @@ namespace kzh {
     void rename_context(string_t const&);
 
   private:
-    ostream& log(char lvl) const;
+    logstream log(char lvl) const;
     string_t context_;
 
-    static ostringstream  sink;
     static ostream*       out;
     static bool           with_timestamps;
     static bool           with_app_name;
     static bool           silenced;
     static string_t       app_name;
-    static int            indent_level;
+    static std::atomic<int> indent_level;
 
     string_t uuid_prefix_;
   }; // end of logger class
 
+  /**
+   * Buffers a single message and writes it out as a whole once it goes out of
+   * scope, so that messages logged from different threads do not interleave.
+   *
+   * A logstream with no output stream discards everything fed to it.
+   */
   struct KARAZEH_EXPORT logstream {
-    logstream(std::ostream&);
+    logstream(std::ostream*);
+    logstream(logstream&&);
     ~logstream();
 
-    std::ostream &s;
-
     template<typename T>
     inline logstream& operator<<(T const& data) {
-      s << data;
+      if (out) {
+        buf << data;
+      }
+
       return *this;
     }
+
+  private:
+    std::ostream *out;
+    std::ostringstream buf;
   };
 
 } // end of namespace kzh
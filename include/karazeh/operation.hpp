@@ -30,6 +30,8 @@
 
 namespace kzh {
   struct release_manifest;
+  class digest_cache;
+  class delta_codec;
 
   enum STAGE_RC {
     STAGE_OK = 0,
@@ -57,6 +59,16 @@ namespace kzh {
     STAGE_INTERNAL_ERROR
   };
 
+  /**
+   * A delta applied on the output of the one before it, for operations that
+   * stand in for those of several releases; see release_planner.
+   */
+  struct chained_delta_t {
+    string_t url;
+    string_t checksum;
+    delta_codec const* codec;
+  };
+
   class KARAZEH_EXPORT operation {
   public:
     explicit operation(int id, config_t const& config, release_manifest const& release);
@@ -107,10 +119,20 @@ namespace kzh {
      */
     inline virtual void commit() {};
 
+    /**
+     * Brings the digests of the files the operation has deployed up to date
+     * in the cache, using the checksums they were verified against so that
+     * they need not be read again. Called after commit().
+     */
+    inline virtual void refresh_digests(digest_cache&) const {};
+
     /** Used internally for exceptions and logging */
     inline virtual string_t tostring() { return ""; }
 
   protected:
+    /** The hasher to verify the files of this operation with */
+    hasher const* get_hasher() const;
+
     int const id_;
     config_t const& config_;
     release_manifest const&rm_;
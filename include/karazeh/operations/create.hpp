@@ -21,6 +21,7 @@
 #ifndef H_KARAZEH_OPERATION_CREATE_H
 #define H_KARAZEH_OPERATION_CREATE_H
 
+#include <vector>
 #include "karazeh_export.h"
 #include "karazeh/operation.hpp"
 #include "karazeh/logger.hpp"
@@ -43,6 +44,9 @@ namespace kzh {
      * 2. Running user must have write permissions for dst_path
      * 3. Enough available space to hold src_size bytes
      *
+     * Any chained deltas are downloaded and applied on the staged file right
+     * after it.
+     *
      * @throw kzh::invalid_resource if the file couldn't be DLed
      *
      * Returns STAGE_OK on success, otherwise an error indicated by the return code,
@@ -53,6 +57,8 @@ namespace kzh {
     virtual void rollback();
     virtual void commit();
 
+    virtual void refresh_digests(digest_cache&) const;
+
     virtual string_t tostring();
 
     string_t  src_checksum;
@@ -60,11 +66,26 @@ namespace kzh {
     string_t  dst_path;
     bool      is_executable;
 
+    /**
+     * Deltas to apply, in order, on the downloaded file while staging, for
+     * when later releases update a file this one creates; see
+     * release_planner. #patched_checksum is that of the file after the last
+     * of them.
+     */
+    std::vector<chained_delta_t> chained_deltas;
+    string_t  patched_checksum;
+
     void marked_for_deletion();
   protected:
     bool has_deployed() const;
     path_t get_destination() const;
 
+    /** The checksum of the file that ends up at the destination */
+    string_t const& get_checksum() const;
+
+    /** Applies the chained deltas on the staged file, see stage() */
+    STAGE_RC apply_chained_deltas();
+
   private:
     path_t cache_path_;
 
@@ -56,6 +56,8 @@ namespace kzh {
 
     virtual void commit();
 
+    virtual void refresh_digests(digest_cache&) const;
+
     virtual string_t tostring();
 
     string_t dst_path;
@@ -49,8 +49,11 @@ namespace kzh {
 
     /**
      * Verifies the source's existence and its integrity, then
-     * computes the source's signature, and downloads the delta
-     * file.
+     * downloads the delta file.
+     *
+     * When config_t::stream_patches is set, the delta is applied on the source
+     * as it is being downloaded instead, and deploy() only has to swap the
+     * patched file in.
      *
      * Returns STAGE_OK on success, otherwise an error indicated by the return code,
      * see karazeh/operation.hpp for a complete listing.
@@ -74,6 +77,8 @@ namespace kzh {
      */
     virtual void commit();
 
+    virtual void refresh_digests(digest_cache&) const;
+
     virtual string_t tostring();
 
     inline const path_t& basis_path() const { return basis_path_; };
@@ -83,6 +88,20 @@ namespace kzh {
     string_t delta_checksum;
     string_t patched_checksum; /* Checksum of the file post-patching (the new one) */
 
+    /**
+     * The codec the delta was encoded with, and is applied with; librsync's
+     * unless the manifest names another, see delta_codec::find().
+     */
+    delta_codec const* codec;
+
+    /**
+     * Deltas to apply, in order, on the result of the first one; this is how
+     * the updates of several releases to the same file are applied in one go,
+     * see release_planner. #patched_checksum is that of the file after the
+     * last of them.
+     */
+    std::vector<chained_delta_t> chained_deltas;
+
   private:
     /** Fully qualified path to the basis file */
     const path_t basis_path_;
@@ -90,20 +109,30 @@ namespace kzh {
     /** URI of the delta patch file */
     const string_t delta_url_;
 
-    /** Path to where the signature will be generated */
-    const path_t signature_path_;
-
     /** Path to where the delta will be downloaded */
     const path_t delta_path_;
 
     /** Path to where the patched version of the basis will be stored */
     const path_t patched_path_;
 
-    delta_encoder encoder_;
+    /** Where the chained delta at the given index is downloaded to */
+    path_t get_chained_delta_path(size_t) const;
+
+    /**
+     * Downloads a delta straight into a patch job on the given basis, writing
+     * the result out to #patched_path_; see stage()
+     */
+    STAGE_RC stream_patch(path_t const& basis, string_t const& url, string_t const& checksum, delta_codec const*);
+
+    /** Applies the chained deltas on #patched_path_, one after the other */
+    STAGE_RC apply_chained_deltas();
 
     void cleanup();
 
     bool patched_;
+
+    /** Whether the patched file was already produced while staging */
+    bool streamed_;
   };
 
 } // end of namespace kzh
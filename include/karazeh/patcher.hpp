@@ -40,6 +40,17 @@ namespace kzh {
     virtual ~patcher();
 
     /**
+     * Stages all the operations of the release, then deploys them in order.
+     * Staging is spread across config_t::concurrency threads.
+     *
+     * While staging, the operations call these on the config_t's file_manager
+     * from several threads at once, so an implementation must allow it:
+     * exists(), is_readable(), is_writable(), is_directory(),
+     * create_directory(), ensure_directory(), map_file(), move() and
+     * remove_file(). They also call downloader::fetch() and the hasher
+     * concurrently. The directories may be created inside the repository, for
+     * files that create operations will deploy there; nothing else in the
+     * repository is modified before deploying.
      *
      * @throw invalid_state     if no new releases are pending
      * @throw invalid_resource  if the release manifest couldn't be DLed
@@ -28,7 +28,7 @@
 
 namespace kzh {
   struct KARAZEH_EXPORT release_manifest {
-    inline release_manifest() {};
+    inline release_manifest() : size(0), hasher(nullptr) {};
     inline ~release_manifest() {
       while (!operations.empty()) {
         delete operations.back();
@@ -46,6 +46,25 @@ namespace kzh {
     string_t tag;
     string_t uri;
 
+    /**
+     * Set on cumulative releases, which take the application from their head
+     * straight to this version, skipping the ones in between. Their id only
+     * has to be unique.
+     */
+    string_t target;
+
+    /**
+     * The number of bytes applying the release downloads, if the manifest
+     * declared it; 0 otherwise.
+     */
+    uint64_t size;
+
+    /**
+     * The hasher the checksums of this release were calculated with, if the
+     * manifest asked for one; config_t::hasher is used otherwise.
+     */
+    kzh::hasher const* hasher;
+
     std::vector<operation*> operations;
   };
 
@@ -0,0 +1,85 @@
+/**
+ * karazeh -- the library for patching software
+ *
+ * Copyright (C) 2011-2016 by Ahmad Amireh <ahmad@amireh.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#ifndef H_KARAZEH_RELEASE_PLANNER_H
+#define H_KARAZEH_RELEASE_PLANNER_H
+
+#include <vector>
+#include "karazeh_export.h"
+#include "karazeh/karazeh.hpp"
+#include "karazeh/logger.hpp"
+#include "karazeh/config.hpp"
+#include "karazeh/release_manifest.hpp"
+
+namespace kzh {
+
+  /**
+   * @class release_planner
+   * @brief
+   * Folds a chain of releases into as few as possible, so that they can be
+   * applied in one stage/deploy pass each.
+   *
+   * Consecutive releases are composed into a single one that holds the net
+   * operations on every file they touch: files that are created and later
+   * deleted aren't downloaded at all, files that are updated and later
+   * deleted are simply deleted, and the deltas of files that are updated, or
+   * created and then updated, several times are chained into one operation.
+   *
+   * A release that can't be composed with the ones before it, like one that
+   * uses another hasher or touches a file inside a directory another one
+   * deletes, starts a new coalesced release.
+   */
+  class KARAZEH_EXPORT release_planner : protected logger {
+  public:
+    explicit release_planner(config_t const&);
+    virtual ~release_planner();
+
+    release_planner(const release_planner&) = delete;
+    release_planner& operator=(const release_planner&) = delete;
+
+    /**
+     * @param releases
+     *        The releases to apply, in order, with their operations loaded;
+     *        see version_manifest::get_available_updates().
+     *
+     * @return The releases to apply in their place, in order. Those that
+     * stand in for several are owned by the planner, and stay valid for as
+     * long as it does; the rest are the ones passed in.
+     */
+    std::vector<release_manifest const*> coalesce(std::vector<release_manifest const*> const& releases);
+
+  private:
+    struct plan_t;
+
+    /**
+     * Adds the operations of a release to the plan, or leaves the plan as it
+     * was if they can't be composed with it.
+     */
+    bool fold(plan_t&, release_manifest const&) const;
+
+    /** Builds the release that carries out a plan of several releases */
+    release_manifest* make_release(plan_t const&) const;
+
+    config_t const& config_;
+    std::vector<release_manifest*> releases_;
+  };
+
+} // end of namespace kzh
+
+#endif
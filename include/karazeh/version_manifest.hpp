@@ -22,6 +22,7 @@
 #define H_KARAZEH_VERSION_MANIFEST_H
 
 #include <map>
+#include <unordered_map>
 #include <vector>
 #include "json11/json11.hpp"
 #include "karazeh_export.h"
@@ -107,6 +108,9 @@ namespace kzh {
      *        - if a release construct is missing the "identity" attribute
      *        - if a release construct's "identity" attribute points to an
      *          undefined identity list
+     *        - if a release construct's "size" attribute is negative or not
+     *          a number
+     *        - if the manifest asks for a hasher that is not available
      *
      * @throw std::domain_error
      *        - if an identity file is unreadable
@@ -132,6 +136,11 @@ namespace kzh {
     /**
      * Attempt to identify the current application version.
      *
+     * The identity files are digested on up to config_t::concurrency threads,
+     * and files that appear in several identity lists are digested only once.
+     * With config_t::cache_digests set, files that haven't changed since the
+     * last time are not digested at all, see digest_cache.
+     *
      * @return A string representing the release "id", and an empty one if the
      * version could not be identified.
      *
@@ -142,8 +151,19 @@ namespace kzh {
     string_t get_current_version() const;
 
     /**
-     * @return A list of release IDs that need to be applied to transition the
-     * application to the latest version.
+     * Releases form a graph where each one leads from its "head" to itself,
+     * or to its "target" for cumulative releases. The latest version is one
+     * reachable from the current version that no release has for a head, the
+     * last one listed if there are several or none at all.
+     *
+     * The path taken to it is the one that downloads the fewest bytes going
+     * by the "size" the releases declare, and then the one with the fewest
+     * releases. Releases that don't declare a size are counted as free, so
+     * either all of them should or none. Releases don't need to be listed in
+     * order.
+     *
+     * @return A list of release IDs that need to be applied, in order, to
+     * transition the application to the latest version.
      */
     vector<string_t> get_available_updates(const string_t& current_version) const;
 
@@ -152,6 +172,12 @@ namespace kzh {
      */
     release_manifest const* get_release(const string_t&) const;
 
+    /**
+     * @return The hasher the manifest's checksums were calculated with; the
+     * one in the config unless the manifest specifies otherwise.
+     */
+    hasher const* get_hasher() const;
+
   private:
     struct identity_list_t {
       inline explicit identity_list_t(string_t const& name) : name(name) {};
@@ -165,7 +191,14 @@ namespace kzh {
 
     map<string_t, identity_list_t> identity_lists_;
     vector<release_manifest*>      releases_;
+
+    /** positions of the releases in #releases_ by their id */
+    std::unordered_map<string_t, size_t> release_indices_;
+
+    /** positions of the releases in #releases_ by the id of their head */
+    std::unordered_map<string_t, vector<size_t>> releases_by_head_;
     config_t                       const &config_;
+    hasher                         const *hasher_;
 
     release_manifest* find_or_create_release(JSON const&);
     operation* parse_operation(release_manifest const&, JSON const&, JSON const&, int const) const;
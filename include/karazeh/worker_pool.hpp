@@ -0,0 +1,71 @@
+/**
+ * karazeh -- the library for patching software
+ *
+ * Copyright (C) 2011-2016 by Ahmad Amireh <ahmad@amireh.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef H_KARAZEH_WORKER_POOL_H
+#define H_KARAZEH_WORKER_POOL_H
+
+#include <functional>
+#include "karazeh_export.h"
+#include "karazeh/karazeh.hpp"
+
+namespace kzh {
+
+  /**
+   * @class worker_pool
+   * @brief
+   * Runs a batch of independent tasks across a fixed number of threads.
+   *
+   * Tasks are identified by their index in the batch and are handed out to the
+   * workers in order. A task reports failure by returning false, after which no
+   * further tasks will be started; those already running are allowed to finish.
+   */
+  class KARAZEH_EXPORT worker_pool {
+  public:
+    typedef std::function<bool(size_t)> task_t;
+
+    /**
+     * @param size
+     *        The number of worker threads to use. A size lower than 2 runs all
+     *        tasks on the calling thread.
+     */
+    explicit worker_pool(int size);
+    virtual ~worker_pool();
+
+    /**
+     * Runs task for every index in [0, count) and blocks until all workers
+     * are done.
+     *
+     * @return true if every task was run and returned true, false otherwise.
+     *
+     * @throw whatever the first failing task has thrown; the exception is
+     *        re-thrown on the calling thread once all workers have stopped.
+     */
+    bool run(size_t count, task_t const& task) const;
+
+    /** The number of worker threads used by run() */
+    int size() const;
+
+  private:
+    int size_;
+  };
+
+} // end of namespace kzh
+
+#endif
@@ -0,0 +1,96 @@
+#include <boost/filesystem.hpp>
+#include "catch.hpp"
+#include "fakeit.hpp"
+#include "test_utils.hpp"
+#include "karazeh/karazeh.hpp"
+#include "karazeh/file_manager.hpp"
+#include "karazeh/caching_file_manager.hpp"
+
+TEST_CASE("caching_file_manager") {
+  using namespace kzh;
+  using fakeit::Mock;
+  using fakeit::Verify;
+
+  const path_t root(test_config.temp_path / "caching_file_manager_test");
+  const path_t cache(root / ".kzh" / "cache");
+
+  test_utils::create_file(root / "bin" / "app", "Hello");
+  test_utils::create_file(root / "README", "Hello World!");
+  test_utils::create_file(cache / "junk", "");
+
+  file_manager inner;
+  Mock<file_manager> inner_spy(inner);
+
+  fakeit::Spy(FI_FILE_MANAGER_IS_READABLE(inner_spy));
+  fakeit::Spy(FI_FILE_MANAGER_IS_WRITABLE(inner_spy));
+  fakeit::Spy(FI_FILE_MANAGER_MOVE(inner_spy));
+  fakeit::Spy(FI_FILE_MANAGER_REMOVE_FILE(inner_spy));
+
+  caching_file_manager subject(inner_spy.get(), root, cache);
+
+  SECTION("Answering from the cache") {
+    REQUIRE(subject.exists(root / "bin/app"));
+    REQUIRE(subject.exists(root / "bin/./../README"));
+    REQUIRE_FALSE(subject.exists(root / "bin/missing"));
+    REQUIRE(subject.is_directory(root / "bin"));
+    REQUIRE_FALSE(subject.is_directory(root / "README"));
+    REQUIRE(subject.stat_filesize(root / "README") == 12);
+    REQUIRE(subject.stat_filesize(root / "bin/missing") == 0);
+
+    REQUIRE(subject.is_readable(root / "bin/app"));
+    REQUIRE(subject.is_readable(root / "bin/app"));
+    REQUIRE(subject.is_readable((root / "bin/app").string()));
+
+    // once for "bin" (by is_directory()) and once for "bin/app"
+    Verify(FI_FILE_MANAGER_IS_READABLE(inner_spy)).Twice();
+  }
+
+  SECTION("Checking permissions of a file to be created") {
+    REQUIRE(subject.is_writable(root / "bin/new_file"));
+    REQUIRE(subject.is_writable(root / "bin/another_new_file"));
+    REQUIRE_FALSE(subject.is_writable(root / "missing_dir/new_file"));
+    REQUIRE_FALSE(subject.is_writable(root / "README/new_file"));
+
+    Verify(FI_FILE_MANAGER_IS_WRITABLE(inner_spy)).Once();
+  }
+
+  SECTION("Updating entries that were moved or removed") {
+    REQUIRE(subject.move(root / "bin", root / "lib"));
+
+    REQUIRE_FALSE(subject.exists(root / "bin"));
+    REQUIRE_FALSE(subject.exists(root / "bin/app"));
+    REQUIRE(subject.exists(root / "lib/app"));
+
+    REQUIRE(subject.remove_file(root / "lib/app"));
+    REQUIRE_FALSE(subject.exists(root / "lib/app"));
+    REQUIRE(subject.is_directory(root / "lib"));
+
+    REQUIRE(subject.ensure_directory(root / "a/b/c"));
+    REQUIRE(subject.is_directory(root / "a"));
+    REQUIRE(subject.is_directory(root / "a/b/c"));
+  }
+
+  SECTION("Delegating paths in the excluded directory") {
+    REQUIRE(subject.exists(cache / "junk"));
+
+    test_utils::create_file(cache / "downloaded", "");
+
+    REQUIRE(subject.exists(cache / "downloaded"));
+    REQUIRE(subject.is_readable(cache / "downloaded"));
+    REQUIRE(subject.is_readable(cache / "downloaded"));
+
+    Verify(FI_FILE_MANAGER_IS_READABLE(inner_spy)).Twice();
+  }
+
+  SECTION("Refreshing") {
+    test_utils::create_file(root / "created_behind_our_back", "");
+
+    REQUIRE_FALSE(subject.exists(root / "created_behind_our_back"));
+
+    subject.refresh();
+
+    REQUIRE(subject.exists(root / "created_behind_our_back"));
+  }
+
+  boost::filesystem::remove_all(root);
+}
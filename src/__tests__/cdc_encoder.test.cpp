@@ -0,0 +1,127 @@
+#include "karazeh/karazeh.hpp"
+#include "karazeh/cdc_encoder.hpp"
+#include "karazeh/delta_encoder.hpp"
+#include "karazeh/path_resolver.hpp"
+#include "karazeh/file_manager.hpp"
+#include "karazeh/hashers/md5_hasher.hpp"
+#include "test_utils.hpp"
+#include "catch.hpp"
+#include <random>
+#include <sstream>
+
+namespace fs = boost::filesystem;
+using namespace kzh;
+
+TEST_CASE("CDCEncoder") {
+  kzh::path_resolver  path_resolver;
+  kzh::file_manager   file_manager;
+  kzh::cdc_encoder    encoder(cdc_encoder::DEFAULT_AVERAGE_CHUNK_SIZE, 4);
+  kzh::md5_hasher     md5_hasher;
+  string_t            basis, new_file;
+
+  path_resolver.resolve(test_config.fixture_path);
+
+  REQUIRE(file_manager.load_file(path_resolver.get_root_path() / "sample_application/0.1.1/data/common.tar", basis));
+  REQUIRE(file_manager.load_file(path_resolver.get_root_path() / "sample_application/0.1.2/data/common.tar", new_file));
+
+  auto encode = [&](string_t const& basis, string_t const& new_file) -> string_t {
+    std::istringstream basis_in(basis);
+    std::ostringstream sig_out;
+
+    REQUIRE(RS_DONE == encoder.signature(basis_in, sig_out));
+
+    std::istringstream sig_in(sig_out.str());
+    std::istringstream new_file_in(new_file);
+    std::ostringstream delta_out;
+
+    REQUIRE(RS_DONE == encoder.delta(sig_in, new_file_in, delta_out));
+
+    return delta_out.str();
+  };
+
+  SECTION("it should be registered as a codec") {
+    REQUIRE(delta_codec::find("cdc") != nullptr);
+    REQUIRE(delta_codec::find("cdc")->name() == "cdc");
+    REQUIRE(delta_codec::find("rsync")->name() == "rsync");
+    REQUIRE(delta_codec::find("bsdiff") == nullptr);
+  }
+
+  SECTION("it should reject chunk sizes that aren't powers of two") {
+    REQUIRE_THROWS_AS(cdc_encoder(3000), invalid_state);
+    REQUIRE_THROWS_AS(cdc_encoder(128), invalid_state);
+  }
+
+  SECTION("it should generate deltas and patch with them") {
+    const string_t delta(encode(basis, new_file));
+    std::istringstream delta_in(delta);
+    std::ostringstream target;
+
+    REQUIRE(delta.size() < new_file.size());
+    REQUIRE(RS_DONE == encoder.patch(basis.data(), basis.size(), delta_in, target));
+    REQUIRE(target.str() == new_file);
+  }
+
+  SECTION("it should patch as the delta is written to a stream") {
+    const string_t delta(encode(basis, new_file));
+    std::ostringstream target;
+    patch_stream patch(encoder.begin_patch(basis.data(), basis.size(), target));
+
+    for (size_t offset = 0; offset < delta.size(); offset += 1021) {
+      REQUIRE(patch.write(delta.data() + offset, std::min<size_t>(1021, delta.size() - offset)));
+    }
+
+    REQUIRE(RS_DONE == patch.finish());
+    REQUIRE(target.str() == new_file);
+  }
+
+  SECTION("it should only lose the chunks around an insertion") {
+    std::minstd_rand rng(42);
+    string_t random_basis(20 * 1024 * 1024, '\0');
+
+    for (size_t i = 0; i < random_basis.size(); ++i) {
+      random_basis[i] = static_cast<char>(rng());
+    }
+
+    string_t shifted(random_basis);
+
+    shifted.insert(1000, "karazeh");
+
+    const string_t delta(encode(random_basis, shifted));
+    std::istringstream delta_in(delta);
+    std::ostringstream target;
+
+    REQUIRE(delta.size() < 128 * 1024);
+    REQUIRE(RS_DONE == encoder.patch(random_basis.data(), random_basis.size(), delta_in, target));
+    REQUIRE(target.str() == shifted);
+  }
+
+  SECTION("it should reject malformed deltas") {
+    const string_t delta(encode(basis, new_file));
+    std::ostringstream target;
+
+    std::istringstream truncated(delta.substr(0, delta.size() - 1));
+    REQUIRE(RS_INPUT_ENDED == encoder.patch(basis.data(), basis.size(), truncated, target));
+
+    std::istringstream trailing(delta + "x");
+    REQUIRE(RS_CORRUPT == encoder.patch(basis.data(), basis.size(), trailing, target));
+
+    std::istringstream not_cdc("\x72\x73\x02\x36\x00");
+    REQUIRE(RS_BAD_MAGIC == encoder.patch(basis.data(), basis.size(), not_cdc, target));
+
+    std::istringstream past_basis(string_t("\x6b\x7a\x63\x02\x01", 5) + string_t(8, '\x7f') + string_t(8, '\x01'));
+    REQUIRE(RS_CORRUPT == encoder.patch(basis.data(), basis.size(), past_basis, target));
+  }
+
+  SECTION("it should reject signatures it didn't generate") {
+    std::istringstream basis_in(basis);
+    std::ostringstream sig_out;
+
+    REQUIRE(RS_DONE == delta_encoder().signature(basis_in, sig_out));
+
+    std::istringstream sig_in(sig_out.str());
+    std::istringstream new_file_in(new_file);
+    std::ostringstream delta_out;
+
+    REQUIRE(RS_BAD_MAGIC == encoder.delta(sig_in, new_file_in, delta_out));
+  }
+}
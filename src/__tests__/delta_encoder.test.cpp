@@ -6,6 +6,8 @@
 #include "karazeh/hashers/md5_hasher.hpp"
 #include "test_utils.hpp"
 #include "catch.hpp"
+#include <random>
+#include <sstream>
 
 namespace fs = boost::filesystem;
 using namespace kzh;
@@ -67,6 +69,28 @@ TEST_CASE("DeltaEncoder") {
     REQUIRE(sig_checksum == md5_hasher.hex_digest(sig_path).digest);
   }
 
+  SECTION("it should pick block lengths based on the basis size") {
+    REQUIRE(signature_options_t::for_size(0).block_length == RS_DEFAULT_BLOCK_LEN);
+    REQUIRE(signature_options_t::for_size(20480).block_length == RS_DEFAULT_BLOCK_LEN);
+    REQUIRE(signature_options_t::for_size(4294967296ul).block_length == 65536);
+    REQUIRE(signature_options_t::for_size(4294967297ul).block_length == 65536 + 128);
+    REQUIRE(signature_options_t::for_size(4294967296ul).strong_length == RS_MAX_STRONG_SUM_LENGTH);
+  }
+
+  SECTION("it should generate a signature with the given options") {
+    const signature_options_t options(4096, 8);
+
+    REQUIRE(RS_DONE == encoder.signature(archive_011, sig_path, options));
+
+    // a 12 byte header, then 4 bytes of weak and 8 of strong sum per block
+    REQUIRE(file_manager.stat_filesize(sig_path) == 12 + (20480 / 4096) * (4 + 8));
+
+    REQUIRE_THROWS_AS(
+      encoder.signature(archive_011, sig_path, signature_options_t(4096, 64)),
+      invalid_state
+    );
+  }
+
   SECTION("it should generate a delta") {
     REQUIRE(RS_DONE == encoder.signature(archive_011.c_str(), sig_path.c_str()));
 
@@ -97,5 +121,97 @@ TEST_CASE("DeltaEncoder") {
     REQUIRE(target_checksum == md5_hasher.hex_digest(target_path).digest);
   }
 
+  SECTION("it should generate deltas and patch in memory") {
+    string_t basis, new_file;
+
+    REQUIRE(file_manager.load_file(archive_011, basis));
+    REQUIRE(file_manager.load_file(archive_012, new_file));
+
+    std::istringstream basis_in(basis);
+    std::ostringstream sig_out;
+
+    REQUIRE(RS_DONE == encoder.signature(basis_in, sig_out));
+    REQUIRE(sig_checksum == md5_hasher.hex_digest(sig_out.str()).digest);
+
+    std::istringstream sig_in(sig_out.str());
+    std::istringstream new_file_in(new_file);
+    std::ostringstream delta_out;
+
+    REQUIRE(RS_DONE == encoder.delta(sig_in, new_file_in, delta_out));
+    REQUIRE(delta_checksum == md5_hasher.hex_digest(delta_out.str()).digest);
+
+    const string_t delta(delta_out.str());
+    std::istringstream delta_in(delta);
+    std::ostringstream streamed_target, buffered_target;
+
+    REQUIRE(RS_DONE == encoder.patch(basis.data(), basis.size(), delta_in, streamed_target));
+    REQUIRE(RS_DONE == encoder.patch(basis.data(), basis.size(), delta.data(), delta.size(), buffered_target));
+
+    REQUIRE(target_checksum == md5_hasher.hex_digest(streamed_target.str()).digest);
+    REQUIRE(streamed_target.str() == buffered_target.str());
+  }
+
+  SECTION("it should patch a file as the delta is written to a stream") {
+    string_t basis, delta;
+
+    REQUIRE(RS_DONE == encoder.signature(archive_011.c_str(), sig_path.c_str()));
+    REQUIRE(RS_DONE == encoder.delta(sig_path.c_str(), archive_012.c_str(), delta_path.c_str()));
+
+    REQUIRE(file_manager.load_file(archive_011, basis));
+    REQUIRE(file_manager.load_file(delta_path, delta));
+
+    std::ostringstream target;
+    patch_stream patch(basis.data(), basis.size(), target);
+
+    // odd-sized pieces, the way they'd come in off the network
+    for (size_t offset = 0; offset < delta.size(); offset += 1021) {
+      REQUIRE(patch.write(delta.data() + offset, std::min<size_t>(1021, delta.size() - offset)));
+    }
+
+    REQUIRE(RS_DONE == patch.finish());
+    REQUIRE(target_checksum == md5_hasher.hex_digest(target.str()).digest);
+  }
+
+  SECTION("it should generate a delta in parallel") {
+    REQUIRE(RS_DONE == encoder.signature(archive_011.c_str(), sig_path.c_str()));
+    REQUIRE(RS_DONE == encoder.delta(sig_path.c_str(), archive_012.c_str(), delta_path.c_str(), 4));
+
+    // small enough for a single region, so it's no different from delta()
+    REQUIRE(delta_checksum == md5_hasher.hex_digest(delta_path).digest);
+  }
+
+  SECTION("it should stitch the deltas of several regions into one") {
+    std::minstd_rand rng(42);
+    string_t basis(130 * 1024 * 1024, '\0');
+
+    for (size_t i = 0; i < basis.size(); ++i) {
+      basis[i] = static_cast<char>(rng());
+    }
+
+    // a few edits on each side of every region boundary
+    string_t new_file(basis);
+
+    for (size_t offset = 1000; offset < new_file.size(); offset += 16 * 1024 * 1024) {
+      new_file.insert(offset, "karazeh");
+    }
+
+    std::istringstream basis_in(basis);
+    std::ostringstream sig_out;
+
+    REQUIRE(RS_DONE == encoder.signature(basis_in, sig_out, signature_options_t(4096, 8)));
+
+    std::istringstream sig_in(sig_out.str());
+    std::ostringstream delta_out;
+
+    REQUIRE(RS_DONE == encoder.delta(sig_in, new_file.data(), new_file.size(), delta_out, 2));
+
+    const string_t delta(delta_out.str());
+    std::ostringstream target;
+
+    REQUIRE(delta.size() < new_file.size() / 100);
+    REQUIRE(RS_DONE == encoder.patch(basis.data(), basis.size(), delta.data(), delta.size(), target));
+    REQUIRE(target.str() == new_file);
+  }
+
   teardown();
 }
\ No newline at end of file
@@ -0,0 +1,110 @@
+#include "karazeh/karazeh.hpp"
+#include "karazeh/digest_cache.hpp"
+#include "karazeh/hashers/md5_hasher.hpp"
+#include "test_utils.hpp"
+#include "catch.hpp"
+#include <atomic>
+#include <boost/filesystem.hpp>
+#include <fstream>
+
+namespace fs = boost::filesystem;
+using namespace kzh;
+
+TEST_CASE("DigestCache") {
+  // counts the files it's asked to digest
+  struct counting_hasher : public md5_hasher {
+    mutable std::atomic<int> nr_digests;
+
+    counting_hasher() : nr_digests(0) {}
+
+    using md5_hasher::hex_digest;
+
+    virtual digest_rc hex_digest(path_t const& path) const {
+      ++nr_digests;
+      return md5_hasher::hex_digest(path);
+    }
+  } hasher;
+
+  const path_t cache_root(test_config.temp_path / "digest_cache_test");
+  const path_t cache_path(cache_root / digest_cache::FILE_NAME);
+  const path_t file_path(cache_root / "identity.txt");
+
+  fs::create_directories(cache_root);
+  test_utils::create_file(file_path, "Hello World!");
+
+  SECTION("it should digest a file only once") {
+    digest_cache cache(cache_path);
+
+    REQUIRE_FALSE(cache.load());
+    REQUIRE(cache.hex_digest(hasher, file_path).digest == "ed076287532e86365e841e92bfc50d8c");
+    REQUIRE(cache.hex_digest(hasher, file_path).digest == "ed076287532e86365e841e92bfc50d8c");
+    REQUIRE(hasher.nr_digests == 1);
+  }
+
+  SECTION("it should remember digests across runs") {
+    {
+      digest_cache cache(cache_path);
+      cache.hex_digest(hasher, file_path);
+      REQUIRE(cache.save());
+    }
+
+    digest_cache cache(cache_path);
+
+    REQUIRE(cache.load());
+    REQUIRE(cache.hex_digest(hasher, file_path).digest == "ed076287532e86365e841e92bfc50d8c");
+    REQUIRE(hasher.nr_digests == 1);
+  }
+
+  SECTION("it should digest a file again once it changes") {
+    digest_cache cache(cache_path);
+
+    cache.hex_digest(hasher, file_path);
+    test_utils::create_file(file_path, "Hello World, again!");
+
+    REQUIRE(cache.hex_digest(hasher, file_path).digest == md5_hasher().hex_digest(file_path).digest);
+    REQUIRE(hasher.nr_digests == 2);
+  }
+
+  SECTION("it should take the digests of deployed files as given") {
+    const path_t other_path(cache_root / "other.txt");
+    digest_cache cache(cache_path);
+
+    test_utils::create_file(other_path, "Hi");
+
+    cache.hex_digest(hasher, file_path);
+    test_utils::create_file(file_path, "Hello World, again!");
+
+    cache.refresh(hasher, file_path, "patched");
+    cache.refresh(hasher, other_path, "unknown");
+
+    REQUIRE(cache.hex_digest(hasher, file_path).digest == "patched");
+    REQUIRE(hasher.nr_digests == 1);
+
+    REQUIRE(cache.hex_digest(hasher, other_path).digest == md5_hasher().hex_digest(other_path).digest);
+    REQUIRE(hasher.nr_digests == 2);
+  }
+
+  SECTION("it should forget removed files") {
+    digest_cache cache(cache_path);
+
+    cache.hex_digest(hasher, file_path);
+    cache.remove(cache_root / "." / "identity.txt");
+    cache.hex_digest(hasher, file_path);
+
+    REQUIRE(hasher.nr_digests == 2);
+  }
+
+  SECTION("it should ignore a malformed cache file") {
+    test_utils::create_file(cache_path, "karazeh-digest-cache 1\nMD5\tlol\n");
+
+    digest_cache cache(cache_path);
+
+    REQUIRE_FALSE(cache.load());
+
+    cache.hex_digest(hasher, file_path);
+
+    REQUIRE(hasher.nr_digests == 1);
+  }
+
+  fs::remove_all(cache_root);
+}
@@ -2,11 +2,188 @@
 #include "karazeh/karazeh.hpp"
 #include "karazeh/downloader.hpp"
 #include "karazeh/hashers/md5_hasher.hpp"
+#include "karazeh/worker_pool.hpp"
 #include "catch.hpp"
+#include "fakeit.hpp"
 #include <boost/filesystem.hpp>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#ifndef _WIN32
+  #include <arpa/inet.h>
+  #include <netinet/in.h>
+  #include <sys/socket.h>
+  #include <unistd.h>
+#endif
 
 namespace fs = boost::filesystem;
 
+#ifndef _WIN32
+  /**
+   * Serves a single file on a loopback port, for the transfers the fixture
+   * server doesn't simulate: the first response is cut short after @cut_at
+   * bytes, and the ones after it honor range requests, ignore them like the
+   * fixture server does, or answer them with data that doesn't match what was
+   * sent the first time.
+   */
+  class flaky_server {
+  public:
+    enum range_mode_t { HONOR_RANGES, IGNORE_RANGES, CORRUPT_RANGES };
+
+    flaky_server(kzh::string_t const& body, size_t cut_at, range_mode_t mode)
+    : body_(body),
+      cut_at_(cut_at),
+      mode_(mode),
+      stopped_(false)
+    {
+      sockaddr_in address;
+      socklen_t address_length = sizeof(address);
+
+      std::memset(&address, 0, sizeof(address));
+      address.sin_family = AF_INET;
+      address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+      address.sin_port = 0;
+
+      socket_ = ::socket(AF_INET, SOCK_STREAM, 0);
+      ::bind(socket_, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+      ::listen(socket_, 4);
+      ::getsockname(socket_, reinterpret_cast<sockaddr*>(&address), &address_length);
+
+      port_ = ntohs(address.sin_port);
+      thread_ = std::thread([this]() { serve(); });
+    }
+
+    ~flaky_server() {
+      stopped_ = true;
+
+      // wake up the accept() the thread is blocked on
+      sockaddr_in address;
+      int client = ::socket(AF_INET, SOCK_STREAM, 0);
+
+      std::memset(&address, 0, sizeof(address));
+      address.sin_family = AF_INET;
+      address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+      address.sin_port = htons(port_);
+
+      ::connect(client, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+      ::close(client);
+
+      thread_.join();
+      ::close(socket_);
+    }
+
+    kzh::string_t host() const {
+      return "http://127.0.0.1:" + std::to_string(port_);
+    }
+
+    /** The Range header of every request served, empty if it had none */
+    std::vector<kzh::string_t> ranges() const {
+      std::lock_guard<std::mutex> lock(mutex_);
+      return ranges_;
+    }
+
+  private:
+    void serve() {
+      for (size_t served = 0; ; ++served) {
+        int client = ::accept(socket_, nullptr, nullptr);
+
+        if (stopped_) {
+          ::close(client);
+          return;
+        }
+
+        #ifdef SO_NOSIGPIPE
+          int on = 1;
+          ::setsockopt(client, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+        #endif
+
+        kzh::string_t request;
+        char buffer[4096];
+        ssize_t length;
+
+        while (request.find("\r\n\r\n") == kzh::string_t::npos && (length = ::recv(client, buffer, sizeof(buffer), 0)) > 0) {
+          request.append(buffer, length);
+        }
+
+        const size_t range_at = request.find("Range: bytes=");
+        const kzh::string_t range(
+          range_at == kzh::string_t::npos ? "" :
+          request.substr(range_at + 13, request.find("\r\n", range_at) - range_at - 13)
+        );
+
+        {
+          std::lock_guard<std::mutex> lock(mutex_);
+          ranges_.push_back(range);
+        }
+
+        respond(client, served, range.empty() ? 0 : std::strtoul(range.c_str(), nullptr, 10));
+
+        ::close(client);
+      }
+    }
+
+    void respond(int client, size_t served, size_t range_start) const {
+      std::ostringstream response;
+      kzh::string_t content(body_);
+
+      if (served == 0) {
+        content.resize(cut_at_);
+        response << "HTTP/1.1 200 OK\r\nContent-Length: " << body_.size() << "\r\n";
+      }
+      else if (range_start > 0 && mode_ != IGNORE_RANGES) {
+        content.erase(0, range_start);
+
+        if (mode_ == CORRUPT_RANGES) {
+          content[0] = ~content[0];
+        }
+
+        response
+          << "HTTP/1.1 206 Partial Content\r\n"
+          << "Content-Range: bytes " << range_start << "-" << body_.size() - 1 << "/" << body_.size() << "\r\n"
+          << "Content-Length: " << content.size() << "\r\n";
+      }
+      else {
+        response << "HTTP/1.1 200 OK\r\nContent-Length: " << body_.size() << "\r\n";
+      }
+
+      response << "Connection: close\r\n\r\n" << content;
+
+      #ifdef MSG_NOSIGNAL
+        const int flags = MSG_NOSIGNAL;
+      #else
+        const int flags = 0;
+      #endif
+
+      const kzh::string_t data(response.str());
+
+      for (size_t sent = 0; sent < data.size(); ) {
+        const ssize_t length = ::send(client, data.data() + sent, data.size() - sent, flags);
+
+        if (length <= 0) {
+          return;
+        }
+
+        sent += length;
+      }
+    }
+
+    const kzh::string_t body_;
+    const size_t cut_at_;
+    const range_mode_t mode_;
+    std::atomic<bool> stopped_;
+    int socket_;
+    unsigned short port_;
+    std::thread thread_;
+    mutable std::mutex mutex_;
+    std::vector<kzh::string_t> ranges_;
+  };
+#endif
+
 TEST_CASE("Downloader") {
   using namespace kzh;
   const path_t temp_file_path(test_config.temp_path / "downloader_test.out");
@@ -14,6 +191,20 @@ TEST_CASE("Downloader") {
   kzh::config_t config(sample_config);
   kzh::downloader subject(config, *config.file_manager);
 
+#ifndef _WIN32
+  // served by flaky_server: larger than the overlap that is requested again
+  // when resuming, and cut short past it
+  string_t body(256 * 1024, '\0');
+
+  for (size_t i = 0; i < body.size(); ++i) {
+    body[i] = static_cast<char>(i * 31 % 251);
+  }
+
+  const size_t cut_at = 160 * 1024;
+  const string_t resume_range(std::to_string(cut_at - 64 * 1024) + "-");
+  const string_t checksum(config.hasher->hex_digest(body).digest);
+#endif
+
   SECTION("it should load a remote resource") {
     string_t buf;
     std::ostringstream s;
@@ -25,6 +216,58 @@ TEST_CASE("Downloader") {
     REQUIRE_FALSE(subject.fetch("/version_woohoohaha.xml", buf));
   }
 
+  SECTION("it should re-use its connections across fetches and threads") {
+    const string_t checksum(config.hasher->hex_digest(test_config.fixture_path / "hash_me.txt").digest);
+    std::vector<string_t> bufs(16);
+
+    REQUIRE(worker_pool(4).run(bufs.size(), [&](size_t i) {
+      return subject.fetch("/hash_me.txt", bufs[i]);
+    }));
+
+    for (auto buf : bufs) {
+      REQUIRE(config.hasher->hex_digest(buf) == checksum);
+    }
+  }
+
+  SECTION("it should download a batch of files asynchronously") {
+    std::map<string_t, bool> results;
+    std::vector<download_job_t> jobs(3);
+
+    jobs[0].url = "/hash_me.txt";
+    jobs[0].path = test_config.temp_path / "downloader_test.async.0";
+    jobs[0].checksum = "f1eb970aeb2e380593480ed76070acbe";
+
+    jobs[1].url = "/sample_application/0.1.1/data/common.tar";
+    jobs[1].path = test_config.temp_path / "downloader_test.async.1";
+    jobs[1].checksum = "427fbbb5a80b517719defe07f7545686";
+
+    jobs[2].url = "/hash_me.txt";
+    jobs[2].path = test_config.temp_path / "downloader_test.async.2";
+    jobs[2].checksum = "dummy_checksum";
+
+    subject.set_retry_count(1);
+    subject.set_max_async_transfers(2);
+
+    for (auto job : jobs) {
+      subject.fetch_async(job, [&](download_job_t const& done, bool success) {
+        results[done.path.string()] = success;
+      });
+    }
+
+    subject.wait();
+
+    REQUIRE(results.size() == 3);
+    REQUIRE(results[jobs[0].path.string()]);
+    REQUIRE(results[jobs[1].path.string()]);
+    REQUIRE_FALSE(results[jobs[2].path.string()]);
+    REQUIRE(config.hasher->hex_digest(jobs[1].path) == jobs[1].checksum);
+    REQUIRE(subject.perform() == 0);
+
+    for (auto job : jobs) {
+      fs::remove(job.path);
+    }
+  }
+
   // takes too long, meh
   //
   // GIVEN("An unreachable host") {
@@ -59,6 +302,19 @@ TEST_CASE("Downloader") {
     REQUIRE(nr_retries == 1);
   }
 
+  SECTION("it should verify the checksum without reading the file back") {
+    md5_hasher hasher;
+    fakeit::Mock<md5_hasher> hasher_spy(hasher);
+
+    fakeit::Spy(FI_HASHER_HEX_DIGEST(hasher_spy));
+
+    config.hasher = &hasher_spy.get();
+
+    REQUIRE(subject.fetch("/hash_me.txt", temp_file_path, "f1eb970aeb2e380593480ed76070acbe"));
+
+    fakeit::Verify(FI_HASHER_HEX_DIGEST(hasher_spy)).Exactly(0);
+  }
+
   SECTION("it should not retry if the checksum matches") {
     int nr_retries = -1;
 
@@ -74,6 +330,47 @@ TEST_CASE("Downloader") {
     REQUIRE(nr_retries == 0);
   }
 
+#ifndef _WIN32
+  SECTION("it should resume an interrupted download from the partial file") {
+    flaky_server server(body, cut_at, flaky_server::HONOR_RANGES);
+    int nr_retries = -1;
+
+    config.host = server.host();
+    subject.set_retry_count(1);
+
+    REQUIRE(subject.fetch("/file", temp_file_path, checksum, &nr_retries));
+    REQUIRE(nr_retries == 1);
+    REQUIRE(server.ranges() == std::vector<string_t>({ "", resume_range }));
+    REQUIRE(config.hasher->hex_digest(temp_file_path).digest == checksum);
+  }
+
+  SECTION("it should download the file again if the partial one doesn't match") {
+    flaky_server server(body, cut_at, flaky_server::CORRUPT_RANGES);
+    int nr_retries = -1;
+
+    config.host = server.host();
+    subject.set_retry_count(2);
+
+    REQUIRE(subject.fetch("/file", temp_file_path, checksum, &nr_retries));
+    REQUIRE(nr_retries == 2);
+    REQUIRE(server.ranges() == std::vector<string_t>({ "", resume_range, "" }));
+    REQUIRE(config.hasher->hex_digest(temp_file_path).digest == checksum);
+  }
+
+  SECTION("it should download the file again if the server ignores ranges") {
+    flaky_server server(body, cut_at, flaky_server::IGNORE_RANGES);
+    int nr_retries = -1;
+
+    config.host = server.host();
+    subject.set_retry_count(2);
+
+    REQUIRE(subject.fetch("/file", temp_file_path, checksum, &nr_retries));
+    REQUIRE(nr_retries == 2);
+    REQUIRE(server.ranges() == std::vector<string_t>({ "", resume_range, "" }));
+    REQUIRE(config.hasher->hex_digest(temp_file_path).digest == checksum);
+  }
+#endif
+
   if (fs::exists(temp_file_path)) {
     fs::remove(temp_file_path);
   }
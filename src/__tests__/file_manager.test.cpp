@@ -8,6 +8,13 @@ using namespace kzh;
 TEST_CASE("FileManager") {
   file_manager subject;
 
+  SECTION("normalizing_paths") {
+    REQUIRE(file_manager::normalize("/root/./a") == path_t("/root/a"));
+    REQUIRE(file_manager::normalize("/root/b/../a") == path_t("/root/a"));
+    REQUIRE(file_manager::normalize("/root//a") == path_t("/root/a"));
+    REQUIRE(file_manager::normalize("../a") == path_t("../a"));
+  }
+
   SECTION("checking_file_read_permissions") {
     REQUIRE(subject.is_readable(test_config.fixture_path / "permissions/readable_file.txt"));
   }
@@ -24,6 +31,15 @@ TEST_CASE("FileManager") {
     REQUIRE_FALSE(subject.is_writable(test_config.fixture_path / "permissions/unwritable_dir"));
   }
 
+  SECTION("checking_write_permissions_of_a_file_to_be_created") {
+    path_t p(test_config.temp_path / "file_to_be_created.txt");
+
+    REQUIRE(subject.is_writable(p));
+    REQUIRE_FALSE(subject.exists(p));
+    REQUIRE_FALSE(subject.is_writable(test_config.temp_path / "missing_dir/file.txt"));
+    REQUIRE_FALSE(subject.is_writable(test_config.fixture_path / "permissions/unwritable_dir/file.txt"));
+  }
+
   SECTION("removing_unwritable_file") {
     path_t p(test_config.fixture_path / "permissions/unwritable_dir/unwritable_file.txt");
 
@@ -66,7 +82,58 @@ TEST_CASE("FileManager") {
     REQUIRE("CALCULATE MY HEX DIGEST\n" == buf);
   }
 
+  SECTION("loading_a_local_file") {
+    string_t buf;
+
+    REQUIRE(subject.load_file(test_config.fixture_path / "hash_me.txt", buf));
+    REQUIRE("CALCULATE MY HEX DIGEST\n" == buf);
+  }
+
+  SECTION("loading_a_large_local_file_from_stream") {
+    path_t p(test_config.temp_path / "large_file.bin");
+    string_t contents(200 * 1024 + 7, '\0');
+    string_t buf;
+
+    for (size_t i = 0; i < contents.size(); ++i) {
+      contents[i] = static_cast<char>(i % 251);
+    }
+
+    test_utils::create_file(p, contents);
+
+    std::ifstream fh(p.string().c_str(), std::ios_base::in | std::ios_base::binary);
+
+    REQUIRE(subject.load_file(fh, buf));
+    REQUIRE(contents == buf);
+
+    test_utils::remove_file(p);
+  }
+
   SECTION("statting_filesize") {
     REQUIRE(24 == subject.stat_filesize(test_config.fixture_path / "hash_me.txt"));
   }
+
+  SECTION("mapping_a_file") {
+    auto file = subject.map_file(test_config.fixture_path / "hash_me.txt");
+
+    REQUIRE(file);
+    REQUIRE(24 == file->size());
+    REQUIRE("CALCULATE MY HEX DIGEST\n" == string_t(file->data(), file->size()));
+  }
+
+  SECTION("mapping_an_empty_file") {
+    path_t p(test_config.temp_path / "empty_file.txt");
+
+    test_utils::create_file(p, "");
+
+    auto file = subject.map_file(p);
+
+    REQUIRE(file);
+    REQUIRE(0 == file->size());
+
+    test_utils::remove_file(p);
+  }
+
+  SECTION("mapping_a_missing_file") {
+    REQUIRE_FALSE(subject.map_file(test_config.fixture_path / "does_not_exist.txt"));
+  }
 }
@@ -3,7 +3,9 @@
 #include "karazeh/patcher.hpp"
 #include "karazeh/path_resolver.hpp"
 #include "karazeh/version_manifest.hpp"
+#include "karazeh/hashers/md5_hasher.hpp"
 #include "test_utils.hpp"
+#include <atomic>
 #include <boost/filesystem.hpp>
 
 using namespace kzh;
@@ -44,6 +46,96 @@ TEST_CASE("Patcher", "[Patcher_JSON]") {
     REQUIRE(subject.apply_update(*release) == STAGE_OK);
   }
 
+  SECTION("#apply_update() refreshes the digest cache") {
+    struct counting_hasher : public md5_hasher {
+      mutable std::atomic<int> nr_digests;
+
+      counting_hasher() : nr_digests(0) {}
+
+      using md5_hasher::hex_digest;
+
+      virtual digest_rc hex_digest(path_t const& path) const {
+        ++nr_digests;
+        return md5_hasher::hex_digest(path);
+      }
+    } hasher;
+
+    kzh::hasher const* original_hasher = sample_config.hasher;
+
+    sample_config.host = sample_config.host + "/sample_application";
+    sample_config.hasher = &hasher;
+    sample_config.cache_digests = true;
+
+    test_utils::copy_directory(
+      test_config.fixture_path / "sample_application/0.1.0",
+      config.root_path
+    );
+
+    version.load_from_uri(config.host + "/manifests/version.json");
+    version.load_release_from_uri(config.host + "/manifests/release__0.1.1.json");
+
+    REQUIRE(version.get_current_version() == "bae3d8f9b767a12336768dacf72cb0de");
+    REQUIRE(subject.apply_update(*version.get_release("ebb5dcbf784e0ef2fe6c37dae8d52722")) == STAGE_OK);
+
+    hasher.nr_digests = 0;
+
+    REQUIRE(version.get_current_version() == "ebb5dcbf784e0ef2fe6c37dae8d52722");
+    REQUIRE(hasher.nr_digests == 0);
+
+    sample_config.hasher = original_hasher;
+    sample_config.cache_digests = false;
+  }
+
+  SECTION("#apply_update() rolls back when any operation fails to stage") {
+    sample_config.host = sample_config.host + "/sample_application";
+
+    test_utils::copy_directory(
+      test_config.fixture_path / "sample_application/0.1.0",
+      config.root_path
+    );
+
+    version.load_from_uri(config.host + "/manifests/version.json");
+    version.load_release_from_string(R"VOGON(
+      {
+        "releases": [{
+          "id": "ebb5dcbf784e0ef2fe6c37dae8d52722",
+          "identity": "Base",
+          "operations": [
+            {
+              "type": "create",
+              "source": {
+                "url": "/0.1.1/data/media/materials/programs/celshader.cg",
+                "checksum": "3858f62230ac3c915f300c664312c63f"
+              },
+              "destination": "/data/media/materials/programs/celshader.cg"
+            },
+            {
+              "type": "create",
+              "source": {
+                "url": "/0.1.1/data/common.tar",
+                "checksum": "427fbbb5a80b517719defe07f7545686"
+              },
+              "destination": "/data/common.tar"
+            },
+            {
+              "type": "delete",
+              "target": "/data/does_not_exist.txt"
+            }
+          ]
+        }]
+      }
+    )VOGON");
+
+    auto release = version.get_release("ebb5dcbf784e0ef2fe6c37dae8d52722");
+
+    REQUIRE(release);
+    REQUIRE(config.concurrency > 1);
+    REQUIRE(subject.apply_update(*release) == STAGE_FILE_MISSING);
+    REQUIRE_FALSE(config.file_manager->exists(config.root_path / "data/common.tar"));
+    REQUIRE_FALSE(config.file_manager->exists(config.root_path / "data/media/materials/programs/celshader.cg"));
+    REQUIRE_FALSE(config.file_manager->exists(config.cache_path / release->id));
+  }
+
   config.file_manager->remove_directory(sample_config.root_path);
 
   sample_config.host          = original_host;
@@ -0,0 +1,163 @@
+#include "catch.hpp"
+#include "karazeh/karazeh.hpp"
+#include "karazeh/patcher.hpp"
+#include "karazeh/path_resolver.hpp"
+#include "karazeh/release_planner.hpp"
+#include "karazeh/version_manifest.hpp"
+#include "test_utils.hpp"
+
+using namespace kzh;
+
+TEST_CASE("ReleasePlanner") {
+  config_t config(sample_config);
+  config.root_path = test_config.fixture_path / "sample_application/0.1.2";
+
+  version_manifest version(config);
+  release_planner subject(config);
+
+  // r1 is the current version, and every release after it builds on the one
+  // before it
+  const auto load_releases = [&](string_t const& r2, string_t const& r3) {
+    version.load_from_string(R"VOGON(
+      {
+        "identities": [{ "name": "Base", "files": [ "bin/test" ] }],
+        "releases": [
+          { "identity": "Base", "id": "r1" },
+          { "identity": "Base", "id": "r2", "head": "r1", "size": 10, "operations": [)VOGON" + r2 + R"VOGON(] },
+          { "identity": "Base", "id": "r3", "head": "r2", "size": 20, "operations": [)VOGON" + r3 + R"VOGON(] }
+        ]
+      }
+    )VOGON");
+
+    return subject.coalesce({ version.get_release("r2"), version.get_release("r3") });
+  };
+
+  const auto create = [](string_t const& path, string_t const& checksum) {
+    return R"({ "type": "create", "source": { "url": "/files)" + path + R"(", "checksum": ")" + checksum + R"(" }, "destination": ")" + path + R"(" })";
+  };
+
+  const auto update = [](string_t const& path, string_t const& from, string_t const& to) {
+    return
+      R"({ "type": "update", "basis": { "pre_checksum": ")" + from + R"(", "post_checksum": ")" + to +
+      R"(", "filepath": ")" + path + R"(" }, "delta": { "checksum": "d)" + to + R"(", "url": "/deltas/)" + to + R"(" } })";
+  };
+
+  const auto remove = [](string_t const& path) {
+    return R"({ "type": "delete", "target": ")" + path + R"(" })";
+  };
+
+  SECTION("it folds releases into one that leads to the last of them") {
+    auto releases = load_releases(create("/a", "A"), create("/b", "B"));
+
+    REQUIRE(releases.size() == 1);
+    REQUIRE(releases[0]->id == "r3");
+    REQUIRE(releases[0]->head == "r1");
+    REQUIRE(releases[0]->size == 30);
+    REQUIRE(releases[0]->operations.size() == 2);
+  }
+
+  SECTION("it drops files that are created and later deleted") {
+    auto releases = load_releases(create("/a", "A"), remove("/a") + "," + create("/b", "B"));
+
+    REQUIRE(releases.size() == 1);
+    REQUIRE(releases[0]->operations.size() == 1);
+
+    auto op = dynamic_cast<create_operation const*>(releases[0]->operations[0]);
+
+    REQUIRE(op);
+    REQUIRE(op->dst_path == "/b");
+  }
+
+  SECTION("it only deletes files that are updated and later deleted") {
+    auto releases = load_releases(update("/c", "X", "Y"), remove("/c"));
+
+    REQUIRE(releases.size() == 1);
+    REQUIRE(releases[0]->operations.size() == 1);
+    REQUIRE(dynamic_cast<delete_operation const*>(releases[0]->operations[0]));
+  }
+
+  SECTION("it chains the deltas of a file that's updated several times") {
+    auto releases = load_releases(update("/c", "X", "Y"), update("/c", "Y", "Z"));
+
+    REQUIRE(releases.size() == 1);
+    REQUIRE(releases[0]->operations.size() == 1);
+
+    auto op = dynamic_cast<update_operation const*>(releases[0]->operations[0]);
+
+    REQUIRE(op);
+    REQUIRE(op->basis_checksum == "X");
+    REQUIRE(op->delta_url() == "/deltas/Y");
+    REQUIRE(op->patched_checksum == "Z");
+    REQUIRE(op->chained_deltas.size() == 1);
+    REQUIRE(op->chained_deltas[0].url == "/deltas/Z");
+    REQUIRE(op->chained_deltas[0].checksum == "dZ");
+  }
+
+  SECTION("it chains the deltas of a file that's created and then updated") {
+    auto releases = load_releases(remove("/c") + "," + create("/c", "Y"), update("/c", "Y", "Z"));
+
+    REQUIRE(releases.size() == 1);
+    REQUIRE(releases[0]->operations.size() == 2);
+    REQUIRE(dynamic_cast<delete_operation const*>(releases[0]->operations[0]));
+
+    auto op = dynamic_cast<create_operation const*>(releases[0]->operations[1]);
+
+    REQUIRE(op);
+    REQUIRE(op->src_checksum == "Y");
+    REQUIRE(op->patched_checksum == "Z");
+    REQUIRE(op->chained_deltas.size() == 1);
+  }
+
+  SECTION("it keeps releases apart when they don't compose") {
+    GIVEN("An update of a file that doesn't match what the releases before it leave") {
+      auto releases = load_releases(update("/c", "X", "Y"), update("/c", "W", "Z"));
+
+      REQUIRE(releases.size() == 2);
+      REQUIRE(releases[0] == version.get_release("r2"));
+      REQUIRE(releases[1] == version.get_release("r3"));
+    }
+
+    GIVEN("A file inside a directory that another release deletes") {
+      auto releases = load_releases(remove("/data"), create("/data/x", "X"));
+
+      REQUIRE(releases.size() == 2);
+    }
+  }
+
+  SECTION("it applies the coalesced release") {
+    path_resolver resolver;
+    const string_t original_host(sample_config.host);
+
+    resolver.resolve(test_config.fixture_path / "sample_application/current");
+
+    // the downloader goes by the sample config
+    sample_config.host = test_config.server_host + "/sample_application";
+
+    config.host = sample_config.host;
+    config.root_path = resolver.get_root_path();
+    config.cache_path = resolver.get_cache_path();
+
+    test_utils::copy_directory(test_config.fixture_path / "sample_application/0.1.0", config.root_path);
+
+    version.load_from_uri(config.host + "/manifests/version.json");
+    version.load_release_from_uri(config.host + "/manifests/release__0.1.1.json");
+    version.load_release_from_uri(config.host + "/manifests/release__0.1.2.json");
+
+    std::vector<release_manifest const*> pending;
+
+    for (auto const& id : version.get_available_updates(version.get_current_version())) {
+      pending.push_back(version.get_release(id));
+    }
+
+    auto releases = subject.coalesce(pending);
+
+    REQUIRE(pending.size() == 2);
+    REQUIRE(releases.size() == 1);
+    REQUIRE(patcher(config).apply_update(*releases[0]) == STAGE_OK);
+    REQUIRE(version.get_current_version() == "f265230773c54396fbf4da894127cfa8");
+
+    config.file_manager->remove_directory(config.root_path);
+
+    sample_config.host = original_host;
+  }
+}
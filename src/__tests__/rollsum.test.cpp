@@ -0,0 +1,84 @@
+#include "catch.hpp"
+#include "karazeh/karazeh.hpp"
+#include <random>
+#include <vector>
+
+extern "C" {
+  #include "librsync-2.0.0/src/rollsum.h"
+}
+
+// the vectorized kernels are built on x86-64 with anything but MSVC, see
+// deps/librsync-2.0.0/CMakeLists.txt
+#if (defined(__x86_64__) || defined(_M_X64)) && !defined(_MSC_VER)
+  #define KZH_TEST_X86_ROLLSUM
+#endif
+
+TEST_CASE("Rollsum") {
+  typedef void (*update_fn)(Rollsum*, const unsigned char*, unsigned int);
+
+  std::vector<std::pair<const char*, update_fn>> kernels;
+
+  kernels.push_back({ "dispatched", RollsumUpdate });
+
+  #if defined(KZH_TEST_X86_ROLLSUM)
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("sse4.1")) {
+      kernels.push_back({ "SSE4.1", RollsumUpdateSSE41 });
+    }
+
+    if (__builtin_cpu_supports("avx2")) {
+      kernels.push_back({ "AVX2", RollsumUpdateAVX2 });
+    }
+  #elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    kernels.push_back({ "NEON", RollsumUpdateNEON });
+  #endif
+
+  SECTION("the vectorized kernels sum exactly like the scalar loop") {
+    std::mt19937 rng(1337);
+    std::vector<unsigned char> buffer(3 * ROLLSUM_SIMD_SPAN + 1000);
+
+    for (auto& byte : buffer) {
+      byte = static_cast<unsigned char>(rng());
+    }
+
+    // lengths around the vector widths and the span the lanes can hold,
+    // plus random ones, at random offsets and on top of a running sum
+    std::vector<unsigned int> lengths = {
+      64, 65, 95, 96, 127, 128, 129, 1000,
+      ROLLSUM_SIMD_SPAN - 1, ROLLSUM_SIMD_SPAN, ROLLSUM_SIMD_SPAN + 1,
+      2 * ROLLSUM_SIMD_SPAN + 33, 3 * ROLLSUM_SIMD_SPAN
+    };
+
+    for (int i = 0; i < 200; ++i) {
+      lengths.push_back(64 + rng() % (3 * ROLLSUM_SIMD_SPAN - 64));
+    }
+
+    for (auto const& kernel : kernels) {
+      for (unsigned int length : lengths) {
+        const size_t offset = rng() % (buffer.size() - length + 1);
+        const unsigned int prefix = rng() % 100;
+        Rollsum expected, actual;
+
+        RollsumInit(&expected);
+
+        for (unsigned int j = 0; j < prefix; ++j) {
+          RollsumRollin(&expected, buffer[j]);
+        }
+
+        actual = expected;
+
+        for (unsigned int j = 0; j < length; ++j) {
+          RollsumRollin(&expected, buffer[offset + j]);
+        }
+
+        kernel.second(&actual, &buffer[offset], length);
+
+        INFO(kernel.first << " over " << length << " bytes at " << offset);
+        REQUIRE(actual.count == expected.count);
+        REQUIRE(actual.s1 == expected.s1);
+        REQUIRE(actual.s2 == expected.s2);
+      }
+    }
+  }
+}
@@ -2,6 +2,8 @@
 #include "karazeh/karazeh.hpp"
 #include "karazeh/version_manifest.hpp"
 #include "karazeh/path_resolver.hpp"
+#include "karazeh/hashers/md5_hasher.hpp"
+#include <atomic>
 #include "test_utils.hpp"
 
 using namespace kzh;
@@ -147,6 +149,55 @@ TEST_CASE("VersionManifest") {
     }
   }
 
+  SECTION("#get_hasher()") {
+    GIVEN("A manifest that does not specify a hasher") {
+      THEN("it uses the configured one") {
+        load_functional_manifest();
+
+        REQUIRE(subject.get_hasher() == config.hasher);
+      }
+    }
+
+    GIVEN("A manifest that specifies a hasher") {
+      auto fixture = R"VOGON(
+        {
+          "hasher": "XXH3",
+          "identities": [{ "name": "Vanilla", "files": [ "bin/test" ] }],
+          "releases": [{
+            "id": "9c399e003105b8dc5d34301b5bf5d42e",
+            "tag": "1.0.0",
+            "identity": "Vanilla"
+          }]
+        }
+      )VOGON";
+
+      THEN("it uses it for the identity and the releases") {
+        subject.load_from_string(fixture);
+
+        REQUIRE(subject.get_hasher()->name() == "XXH3");
+        REQUIRE(subject.get_release("9c399e003105b8dc5d34301b5bf5d42e")->hasher == subject.get_hasher());
+        REQUIRE(subject.get_current_version() == "9c399e003105b8dc5d34301b5bf5d42e");
+      }
+    }
+
+    GIVEN("A manifest that specifies an unknown hasher") {
+      THEN("it throws") {
+        auto fixture = R"VOGON(
+          {
+            "hasher": "CRC32",
+            "identities": [{ "name": "Vanilla", "files": [ "bin/test" ] }],
+            "releases": [{ "id": "asdf", "identity": "Vanilla" }]
+          }
+        )VOGON";
+
+        REQUIRE_THROWS_WITH(
+          subject.load_from_string(fixture),
+          Contains("Version manifest uses an unknown hasher (CRC32).", Catch::CaseSensitive::No)
+        );
+      }
+    }
+  }
+
   SECTION("#get_current_version()") {
     load_functional_manifest();
 
@@ -159,6 +210,80 @@ TEST_CASE("VersionManifest") {
     }
   }
 
+  SECTION("#get_current_version() with identity lists that share files") {
+    // counts digests from the worker threads, which a FakeIt spy can't do
+    struct counting_hasher : public md5_hasher {
+      mutable std::atomic<int> nr_digests;
+
+      counting_hasher() : nr_digests(0) {}
+
+      using md5_hasher::hex_digest;
+
+      virtual digest_rc hex_digest(path_t const& path) const {
+        ++nr_digests;
+        return md5_hasher::hex_digest(path);
+      }
+    } hasher;
+
+    config.hasher = &hasher;
+    config.concurrency = 4;
+
+    const string_t expected_version = hasher.hex_digest(
+      hasher.hex_digest(config.root_path / "bin/test").digest +
+      hasher.hex_digest(config.root_path / "src/main.c").digest
+    ).digest;
+
+    hasher.nr_digests = 0;
+
+    subject.load_from_string(R"VOGON(
+      {
+        "identities": [
+          { "name": "Vanilla", "files": [ "bin/test", "data/hash_me.txt" ] },
+          { "name": "Sources", "files": [ "bin/test", "src/main.c" ] }
+        ],
+        "releases": [
+          { "id": "bae3d8f9b767a12336768dacf72cb0de", "identity": "Vanilla" },
+          { "id": ")VOGON" + expected_version + R"VOGON(", "identity": "Sources" }
+        ]
+      }
+    )VOGON");
+
+    REQUIRE(subject.get_current_version() == expected_version);
+    REQUIRE(hasher.nr_digests == 3);
+  }
+
+  SECTION("#get_current_version() with the digest cache") {
+    struct counting_hasher : public md5_hasher {
+      mutable std::atomic<int> nr_digests;
+
+      counting_hasher() : nr_digests(0) {}
+
+      using md5_hasher::hex_digest;
+
+      virtual digest_rc hex_digest(path_t const& path) const {
+        ++nr_digests;
+        return md5_hasher::hex_digest(path);
+      }
+    } hasher;
+
+    config.hasher = &hasher;
+    config.cache_path = test_config.temp_path / "version_manifest_test";
+    config.cache_digests = true;
+
+    load_functional_manifest();
+
+    const string_t version = subject.get_current_version();
+    const int nr_digests = hasher.nr_digests;
+
+    REQUIRE(version == "f265230773c54396fbf4da894127cfa8");
+    REQUIRE(nr_digests > 0);
+
+    REQUIRE(subject.get_current_version() == version);
+    REQUIRE(hasher.nr_digests == nr_digests);
+
+    boost::filesystem::remove_all(config.cache_path);
+  }
+
   SECTION("#get_available_updates()") {
     load_functional_manifest();
 
@@ -173,6 +298,94 @@ TEST_CASE("VersionManifest") {
     }
   }
 
+  SECTION("#get_available_updates() with releases out of order") {
+    subject.load_from_string(R"VOGON(
+      {
+        "identities": [{ "name": "Base", "files": [ "bin/test" ] }],
+        "releases": [
+          { "identity": "Base", "id": "r3", "head": "r2" },
+          { "identity": "Base", "id": "r1" },
+          { "identity": "Base", "id": "r4", "head": "r3" },
+          { "identity": "Base", "id": "r2", "head": "r1" }
+        ]
+      }
+    )VOGON");
+
+    REQUIRE(subject.get_available_updates("r1") == vector<string_t>({ "r2", "r3", "r4" }));
+    REQUIRE(subject.get_available_updates("r3") == vector<string_t>({ "r4" }));
+    REQUIRE(subject.get_available_updates("r4").empty());
+  }
+
+  SECTION("#get_available_updates() with cumulative releases") {
+    const auto load_with_jump = [&](int jump_size) {
+      subject.load_from_string(R"VOGON(
+        {
+          "identities": [{ "name": "Base", "files": [ "bin/test" ] }],
+          "releases": [
+            { "identity": "Base", "id": "r1" },
+            { "identity": "Base", "id": "r2", "head": "r1", "size": 100 },
+            { "identity": "Base", "id": "r3", "head": "r2", "size": 100 },
+            { "identity": "Base", "id": "r4", "head": "r3", "size": 100 },
+            { "identity": "Base", "id": "r2-r4", "head": "r2", "target": "r4", "size": 150 },
+            { "identity": "Base", "id": "r1-r4", "head": "r1", "target": "r4", "size": )VOGON" +
+              std::to_string(jump_size) + R"VOGON( }
+          ]
+        }
+      )VOGON");
+    };
+
+    GIVEN("A cumulative release that's cheaper than the chain") {
+      load_with_jump(200);
+
+      REQUIRE(subject.get_available_updates("r1") == vector<string_t>({ "r1-r4" }));
+      REQUIRE(subject.get_available_updates("r2") == vector<string_t>({ "r2-r4" }));
+      REQUIRE(subject.get_available_updates("r3") == vector<string_t>({ "r4" }));
+      REQUIRE(subject.get_release("r1-r4")->target == "r4");
+      REQUIRE(subject.get_release("r1-r4")->size == 200);
+    }
+
+    GIVEN("A cumulative release that costs more than the chain") {
+      load_with_jump(400);
+
+      REQUIRE(subject.get_available_updates("r1") == vector<string_t>({ "r2", "r2-r4" }));
+    }
+
+    GIVEN("A release with an invalid size") {
+      REQUIRE_THROWS_WITH(
+        subject.load_from_string(R"VOGON(
+          {
+            "identities": [{ "name": "Base", "files": [ "bin/test" ] }],
+            "releases": [{ "identity": "Base", "id": "r1", "size": -1 }]
+          }
+        )VOGON"),
+        Equals("Release (r1) has an invalid size.")
+      );
+    }
+  }
+
+  SECTION("#get_available_updates() with a long history") {
+    const int nr_releases = 5000;
+    JSON::array releases;
+
+    for (int i = 0; i < nr_releases; ++i) {
+      releases.push_back(JSON::object({
+        { "identity", "Base" },
+        { "id", std::to_string(i) },
+        { "head", i > 0 ? std::to_string(i - 1) : "" }
+      }));
+    }
+
+    subject.parse(JSON::object({
+      { "identities", JSON::array({ JSON::object({ { "name", "Base" }, { "files", JSON::array({ "bin/test" }) } }) }) },
+      { "releases", releases }
+    }));
+
+    REQUIRE(subject.get_release_count() == nr_releases);
+    REQUIRE(subject.get_release("4321")->head == "4320");
+    REQUIRE(subject.get_available_updates("0").size() == nr_releases - 1);
+    REQUIRE(subject.get_available_updates("4998") == vector<string_t>({ "4999" }));
+  }
+
   SECTION("Parsing release manifests") {
     load_functional_manifest();
 
@@ -240,6 +453,75 @@ TEST_CASE("VersionManifest") {
       REQUIRE(op->patched_checksum == "72eda360361e155ad8eabd07f07fa017");
       REQUIRE(op->delta_url() == "/patch_v0.1.1-v0.1.2/data_common.tar.delta");
       REQUIRE(op->delta_checksum == "b02c5026a9e24d0cdefa19641077ca91");
+      REQUIRE(op->codec == delta_codec::find("rsync"));
+    }
+
+    SECTION("Ignoring the signature options of an \"update\" operation") {
+      auto parse_with = [&](string_t const& options) {
+        subject.parse_release(parse_json(
+          R"VOGON({
+            "id": "my fake release",
+            "identity": "Base",
+            "operations": [
+              {
+                "type": "update",
+                "basis": {
+                  "pre_checksum": "427fbbb5a80b517719defe07f7545686",
+                  "post_checksum": "72eda360361e155ad8eabd07f07fa017",
+                  "filepath": "/data/common.tar"
+                },
+
+                "delta": {
+                  "checksum": "b02c5026a9e24d0cdefa19641077ca91",
+                  "url": "/patch_v0.1.1-v0.1.2/data_common.tar.delta"
+                  )VOGON" + options + R"VOGON(
+                }
+              }
+            ]
+          })VOGON"
+        ));
+      };
+
+      REQUIRE_NOTHROW(parse_with(R"(, "block_length": 65536, "strong_length": 16)"));
+      REQUIRE(subject.get_release("my fake release")->operations.size() == 1);
+    }
+
+    SECTION("Parsing the delta encoding of an \"update\" operation") {
+      auto parse_with = [&](string_t const& options) {
+        subject.parse_release(parse_json(
+          R"VOGON({
+            "id": "my fake release",
+            "identity": "Base",
+            "operations": [
+              {
+                "type": "update",
+                "basis": {
+                  "pre_checksum": "427fbbb5a80b517719defe07f7545686",
+                  "post_checksum": "72eda360361e155ad8eabd07f07fa017",
+                  "filepath": "/data/common.tar"
+                },
+
+                "delta": {
+                  "checksum": "b02c5026a9e24d0cdefa19641077ca91",
+                  "url": "/patch_v0.1.1-v0.1.2/data_common.tar.delta"
+                  )VOGON" + options + R"VOGON(
+                }
+              }
+            ]
+          })VOGON"
+        ));
+
+        return static_cast<update_operation*>(
+          subject.get_release("my fake release")->operations.front()
+        );
+      };
+
+      REQUIRE(parse_with(R"(, "encoding": "cdc")")->codec == delta_codec::find("cdc"));
+
+      REQUIRE_THROWS_WITH(
+        parse_with(R"(, "encoding": "bsdiff")"),
+        Catch::Contains("unknown delta encoding")
+      );
     }
 
     SECTION("Parsing a \"delete\" operation") {
@@ -0,0 +1,364 @@
+/**
+ * karazeh -- the library for patching software
+ *
+ * Copyright (C) 2011-2016 by Ahmad Amireh <ahmad@amireh.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "karazeh/caching_file_manager.hpp"
+
+namespace kzh {
+  namespace fs = boost::filesystem;
+
+  /** Whether @key equals @prefix or lies somewhere beneath it. */
+  static bool is_within(string_t const& key, string_t const& prefix) {
+    if (prefix.empty() || key.compare(0, prefix.size(), prefix) != 0) {
+      return false;
+    }
+
+    return key.size() == prefix.size()
+      || path_t::preferred_separator == key[prefix.size()]
+      || path_t::preferred_separator == prefix[prefix.size() - 1];
+  }
+
+  caching_file_manager::caching_file_manager(
+    file_manager const& inner,
+    path_t const& root,
+    path_t const& excluded)
+  : inner_(inner),
+    root_(normalize(root).string()),
+    excluded_(excluded.empty() ? string_t() : normalize(excluded).string())
+  {
+    refresh();
+  }
+
+  caching_file_manager::~caching_file_manager() {
+  }
+
+  void caching_file_manager::refresh() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    scan(root_);
+
+    debug() << "cached " << entries_.size() << " entries under " << root_;
+  }
+
+  bool caching_file_manager::is_cached(string_t const& key) const {
+    return is_within(key, root_) && !is_within(key, excluded_);
+  }
+
+  void caching_file_manager::scan(string_t const& key) const {
+    // drop the entry and everything that used to be under it
+    std::map<string_t, entry_t>::iterator it = entries_.lower_bound(key);
+
+    while (it != entries_.end() && it->first.compare(0, key.size(), key) == 0) {
+      if (is_within(it->first, key)) {
+        entries_.erase(it++);
+      }
+      else {
+        ++it;
+      }
+    }
+
+    boost::system::error_code ec;
+    const fs::file_status status = fs::status(key, ec);
+
+    if (!fs::exists(status)) {
+      return;
+    }
+
+    const entry_t entry = { fs::is_directory(status), -1, -1, false, 0 };
+
+    entries_[key] = entry;
+
+    if (entry.directory && !fs::is_symlink(fs::symlink_status(key, ec))) {
+      scan_directory(key);
+    }
+  }
+
+  void caching_file_manager::scan_directory(path_t const& path) const {
+    boost::system::error_code ec;
+
+    for (fs::directory_iterator it(path, ec), end; !ec && it != end; it.increment(ec)) {
+      const string_t key(normalize(it->path()).string());
+
+      if (!is_cached(key)) {
+        continue;
+      }
+
+      const fs::file_status status = it->status(ec);
+
+      if (!fs::exists(status)) {
+        continue;
+      }
+
+      const entry_t entry = { fs::is_directory(status), -1, -1, false, 0 };
+
+      entries_[key] = entry;
+
+      // don't follow symlinked directories; they could lead us in circles
+      if (entry.directory && fs::is_directory(it->symlink_status(ec))) {
+        scan_directory(it->path());
+      }
+    }
+  }
+
+  void caching_file_manager::invalidate(path_t const& path) const {
+    string_t key(normalize(path).string());
+
+    if (!is_cached(key)) {
+      return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // the operation may have created any number of missing ancestors, so
+    // start from the topmost one we didn't know of
+    for (;;) {
+      const string_t parent(path_t(key).parent_path().string());
+
+      if (!is_cached(parent) || entries_.count(parent)) {
+        break;
+      }
+
+      key = parent;
+    }
+
+    scan(key);
+  }
+
+  bool caching_file_manager::load_file(std::ifstream &fs, string_t& out_buf) const {
+    return inner_.load_file(fs, out_buf);
+  }
+
+  bool caching_file_manager::load_file(string_t const& path, string_t& out_buf) const {
+    return inner_.load_file(path, out_buf);
+  }
+
+  bool caching_file_manager::load_file(path_t const& path, string_t& out_buf) const {
+    return inner_.load_file(path, out_buf);
+  }
+
+  bool caching_file_manager::remove_file(path_t const& path) const {
+    const bool rc = inner_.remove_file(path);
+
+    invalidate(path);
+
+    return rc;
+  }
+
+  bool caching_file_manager::remove_directory(path_t const& path) const {
+    const bool rc = inner_.remove_directory(path);
+
+    invalidate(path);
+
+    return rc;
+  }
+
+  bool caching_file_manager::exists(path_t const& path) const {
+    const string_t key(normalize(path).string());
+
+    if (!is_cached(key)) {
+      return inner_.exists(path);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    return entries_.count(key) > 0;
+  }
+
+  bool caching_file_manager::is_empty(path_t const& path) const {
+    return inner_.is_empty(path);
+  }
+
+  bool caching_file_manager::is_directory(path_t const& path) const {
+    const string_t key(normalize(path).string());
+
+    if (!is_cached(key)) {
+      return inner_.is_directory(path);
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      std::map<string_t, entry_t>::const_iterator it = entries_.find(key);
+
+      if (it == entries_.end() || !it->second.directory) {
+        return false;
+      }
+    }
+
+    return is_readable(path);
+  }
+
+  bool caching_file_manager::is_readable(path_t const& path) const {
+    const string_t key(normalize(path).string());
+
+    if (!is_cached(key)) {
+      return inner_.is_readable(path);
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      std::map<string_t, entry_t>::const_iterator it = entries_.find(key);
+
+      if (it == entries_.end()) {
+        return false;
+      }
+      else if (it->second.readable != -1) {
+        return it->second.readable == 1;
+      }
+    }
+
+    const bool readable = inner_.is_readable(path);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::map<string_t, entry_t>::iterator it = entries_.find(key);
+
+    if (it != entries_.end()) {
+      it->second.readable = readable ? 1 : 0;
+    }
+
+    return readable;
+  }
+
+  bool caching_file_manager::is_readable(string_t const& path) const {
+    return is_readable(path_t(path));
+  }
+
+  bool caching_file_manager::is_writable(path_t const& path) const {
+    const string_t key(normalize(path).string());
+
+    if (!is_cached(key)) {
+      return inner_.is_writable(path);
+    }
+
+    path_t parent;
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      std::map<string_t, entry_t>::const_iterator it = entries_.find(key);
+
+      if (it != entries_.end() && it->second.writable != -1) {
+        return it->second.writable == 1;
+      }
+      else if (it == entries_.end()) {
+        // a file that is yet to be created; that's up to its parent directory
+        parent = path_t(key).parent_path();
+
+        if (is_cached(parent.string())) {
+          std::map<string_t, entry_t>::const_iterator parent_it = entries_.find(parent.string());
+
+          if (parent_it == entries_.end() || !parent_it->second.directory) {
+            return false;
+          }
+        }
+      }
+    }
+
+    if (!parent.empty()) {
+      return is_cached(parent.string()) ? is_writable(parent) : inner_.is_writable(path);
+    }
+
+    const bool writable = inner_.is_writable(path);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::map<string_t, entry_t>::iterator it = entries_.find(key);
+
+    if (it != entries_.end()) {
+      it->second.writable = writable ? 1 : 0;
+    }
+
+    return writable;
+  }
+
+  bool caching_file_manager::is_writable(string_t const& path) const {
+    return is_writable(path_t(path));
+  }
+
+  bool caching_file_manager::move(path_t const& src, path_t const& dest) const {
+    const bool rc = inner_.move(src, dest);
+
+    invalidate(src);
+    invalidate(dest);
+
+    return rc;
+  }
+
+  bool caching_file_manager::create_directory(path_t const& path) const {
+    const bool rc = inner_.create_directory(path);
+
+    invalidate(path);
+
+    return rc;
+  }
+
+  bool caching_file_manager::ensure_directory(path_t const& path) const {
+    const bool rc = inner_.ensure_directory(path);
+
+    invalidate(path);
+
+    return rc;
+  }
+
+  bool caching_file_manager::make_executable(path_t const& path) const {
+    const bool rc = inner_.make_executable(path);
+
+    invalidate(path);
+
+    return rc;
+  }
+
+  uint64_t caching_file_manager::stat_filesize(path_t const& path) const {
+    const string_t key(normalize(path).string());
+
+    if (!is_cached(key)) {
+      return inner_.stat_filesize(path);
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      std::map<string_t, entry_t>::const_iterator it = entries_.find(key);
+
+      if (it == entries_.end()) {
+        return 0;
+      }
+      else if (it->second.sized) {
+        return it->second.size;
+      }
+    }
+
+    const uint64_t size = inner_.stat_filesize(path);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::map<string_t, entry_t>::iterator it = entries_.find(key);
+
+    if (it != entries_.end()) {
+      it->second.sized = true;
+      it->second.size = size;
+    }
+
+    return size;
+  }
+
+  uint64_t caching_file_manager::stat_filesize(std::ifstream& fs) const {
+    return inner_.stat_filesize(fs);
+  }
+
+  std::unique_ptr<mapped_file> caching_file_manager::map_file(path_t const& path) const {
+    return inner_.map_file(path);
+  }
+
+} // end of namespace kzh
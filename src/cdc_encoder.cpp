@@ -0,0 +1,619 @@
+/**
+ * karazeh -- the library for patching software
+ *
+ * Copyright (C) 2011-2016 by Ahmad Amireh <ahmad@amireh.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#define XXH_INLINE_ALL
+#include "xxhash/xxhash.h"
+#include "karazeh/cdc_encoder.hpp"
+#include "karazeh/worker_pool.hpp"
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <unordered_map>
+#include <vector>
+
+namespace kzh {
+
+  static const uint32_t CDC_SIGNATURE_MAGIC = 0x6b7a6301;
+  static const uint32_t CDC_DELTA_MAGIC = 0x6b7a6302;
+
+  enum {
+    CDC_OP_END = 0,
+    CDC_OP_COPY = 1,
+    CDC_OP_LITERAL = 2
+  };
+
+  static const size_t MIN_AVERAGE_CHUNK_SIZE = 256;
+  static const size_t MAX_AVERAGE_CHUNK_SIZE = 1024 * 1024;
+
+  /** sizes of the signature header, and of every chunk entry that follows it */
+  static const size_t SIGNATURE_HEADER_SIZE = 16;
+  static const size_t SIGNATURE_ENTRY_SIZE = 4 + 16;
+
+  /** bytes of input that are read, chunked, and digested at a time */
+  static const size_t BATCH_SIZE = 16 * 1024 * 1024;
+
+  /** runs of literal chunks are split into commands of about this size */
+  static const size_t MAX_LITERAL_SIZE = 1024 * 1024;
+
+  static void put_u32(string_t& out, uint32_t value) {
+    for (int shift = 24; shift >= 0; shift -= 8) {
+      out.push_back(static_cast<char>((value >> shift) & 0xFF));
+    }
+  }
+
+  static void put_u64(string_t& out, uint64_t value) {
+    for (int shift = 56; shift >= 0; shift -= 8) {
+      out.push_back(static_cast<char>((value >> shift) & 0xFF));
+    }
+  }
+
+  static uint64_t get_uint(char const* in, size_t size) {
+    uint64_t value = 0;
+
+    for (size_t i = 0; i < size; ++i) {
+      value = (value << 8) | static_cast<unsigned char>(in[i]);
+    }
+
+    return value;
+  }
+
+  /**
+   * Random values the gear hash adds up for every byte, drawn from splitmix64
+   * with a fixed seed so that every build cuts files the same way.
+   */
+  struct gear_table_t {
+    uint64_t values[256];
+
+    gear_table_t() {
+      uint64_t state = 0;
+
+      for (size_t i = 0; i < 256; ++i) {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        values[i] = z ^ (z >> 31);
+      }
+    }
+  };
+
+  static const gear_table_t GEAR;
+
+  /** The top @bits bits of a 64-bit word; the gear hash mixes those best */
+  static uint64_t top_bits(unsigned bits) {
+    return bits == 0 ? 0 : ~0ull << (64 - bits);
+  }
+
+  /**
+   * Cuts data into chunks of about an average size using FastCDC's normalized
+   * chunking: a stricter pattern is looked for before the average size is
+   * reached, and a looser one after, which keeps chunk sizes close to the
+   * average.
+   */
+  struct chunker_t {
+    uint32_t min_size;
+    uint32_t average_size;
+    uint32_t max_size;
+    uint64_t small_mask;
+    uint64_t large_mask;
+
+    explicit chunker_t(uint32_t average)
+    : min_size(average / 4),
+      average_size(average),
+      max_size(average * 8)
+    {
+      unsigned bits = 0;
+
+      while ((1u << bits) < average) {
+        ++bits;
+      }
+
+      small_mask = top_bits(bits + 2);
+      large_mask = top_bits(bits - 2);
+    }
+
+    /** @return the length of the chunk that starts at @data */
+    size_t cut(char const* data, size_t size) const {
+      unsigned char const* bytes = reinterpret_cast<unsigned char const*>(data);
+      uint64_t hash = 0;
+      size_t i = min_size;
+
+      if (size <= min_size) {
+        return size;
+      }
+
+      size = std::min<size_t>(size, max_size);
+
+      const size_t normal_size = std::min<size_t>(size, average_size);
+
+      for (; i < normal_size; ++i) {
+        hash = (hash << 1) + GEAR.values[bytes[i]];
+
+        if (!(hash & small_mask)) {
+          return i + 1;
+        }
+      }
+
+      for (; i < size; ++i) {
+        hash = (hash << 1) + GEAR.values[bytes[i]];
+
+        if (!(hash & large_mask)) {
+          return i + 1;
+        }
+      }
+
+      return size;
+    }
+  };
+
+  static bool is_valid_average_size(uint64_t size) {
+    return
+      size >= MIN_AVERAGE_CHUNK_SIZE &&
+      size <= MAX_AVERAGE_CHUNK_SIZE &&
+      (size & (size - 1)) == 0;
+  }
+
+  struct digest_t {
+    uint64_t high;
+    uint64_t low;
+
+    bool operator==(digest_t const& other) const {
+      return high == other.high && low == other.low;
+    }
+  };
+
+  struct digest_hash_t {
+    size_t operator()(digest_t const& digest) const {
+      return static_cast<size_t>(digest.low);
+    }
+  };
+
+  struct chunk_t {
+    /** offset of the chunk in the batch it was cut from */
+    size_t offset;
+    size_t length;
+    digest_t digest;
+  };
+
+  typedef std::function<bool(char const*, std::vector<chunk_t> const&)> chunk_visitor_t;
+
+  /**
+   * Reads a file in batches, cuts every batch into chunks and digests them on
+   * the worker pool, then hands the chunks to @visit in order along with the
+   * batch they point into. Whatever is left of a batch after its last full
+   * chunk is carried over to the next one.
+   *
+   * @return RS_IO_ERROR if the file can't be read, RS_DONE otherwise unless
+   *         @visit fails, in which case it's on the visitor to report why
+   */
+  static rs_result for_each_chunk(
+    std::istream& in,
+    chunker_t const& chunker,
+    worker_pool const& workers,
+    chunk_visitor_t const& visit)
+  {
+    std::vector<char> buffer;
+    std::vector<chunk_t> chunks;
+    size_t filled = 0;
+    bool eof = false;
+
+    while (!eof) {
+      buffer.resize(filled + BATCH_SIZE);
+      in.read(&buffer[filled], BATCH_SIZE);
+
+      if (in.bad()) {
+        return RS_IO_ERROR;
+      }
+
+      filled += static_cast<size_t>(in.gcount());
+      eof = in.eof();
+
+      size_t offset = 0;
+
+      chunks.clear();
+
+      while (offset < filled && (eof || filled - offset >= chunker.max_size)) {
+        chunk_t chunk;
+
+        chunk.offset = offset;
+        chunk.length = chunker.cut(&buffer[offset], filled - offset);
+        chunks.push_back(chunk);
+
+        offset += chunk.length;
+      }
+
+      workers.run(chunks.size(), [&](size_t i) {
+        const XXH128_hash_t digest = XXH3_128bits(&buffer[chunks[i].offset], chunks[i].length);
+
+        chunks[i].digest.high = digest.high64;
+        chunks[i].digest.low = digest.low64;
+
+        return true;
+      });
+
+      if (!visit(&buffer[0], chunks)) {
+        return RS_INTERNAL_ERROR;
+      }
+
+      std::memmove(&buffer[0], &buffer[offset], filled - offset);
+      filled -= offset;
+    }
+
+    return RS_DONE;
+  }
+
+  /**
+   * Writes out delta commands, merging copies of adjacent basis chunks and
+   * runs of literal chunks.
+   */
+  class delta_writer {
+  public:
+    explicit delta_writer(std::ostream& out)
+    : out_(out),
+      copy_offset_(0),
+      copy_length_(0)
+    {
+      string_t magic;
+
+      put_u32(magic, CDC_DELTA_MAGIC);
+      out_.write(magic.data(), magic.size());
+    }
+
+    void copy(uint64_t offset, uint64_t length) {
+      flush_literal();
+
+      if (copy_length_ > 0 && copy_offset_ + copy_length_ == offset) {
+        copy_length_ += length;
+        return;
+      }
+
+      flush_copy();
+
+      copy_offset_ = offset;
+      copy_length_ = length;
+    }
+
+    void literal(char const* data, size_t length) {
+      flush_copy();
+
+      literal_.append(data, length);
+
+      if (literal_.size() >= MAX_LITERAL_SIZE) {
+        flush_literal();
+      }
+    }
+
+    /** @return whether all the commands were written */
+    bool end() {
+      flush_copy();
+      flush_literal();
+
+      out_.put(static_cast<char>(CDC_OP_END));
+
+      return !out_.fail();
+    }
+
+  private:
+    void flush_copy() {
+      if (copy_length_ == 0) {
+        return;
+      }
+
+      string_t command(1, static_cast<char>(CDC_OP_COPY));
+
+      put_u64(command, copy_offset_);
+      put_u64(command, copy_length_);
+      out_.write(command.data(), command.size());
+
+      copy_length_ = 0;
+    }
+
+    void flush_literal() {
+      if (literal_.empty()) {
+        return;
+      }
+
+      string_t command(1, static_cast<char>(CDC_OP_LITERAL));
+
+      put_u64(command, literal_.size());
+      out_.write(command.data(), command.size());
+      out_.write(literal_.data(), literal_.size());
+
+      literal_.clear();
+    }
+
+    std::ostream &out_;
+    uint64_t copy_offset_;
+    uint64_t copy_length_;
+    string_t literal_;
+  };
+
+  /**
+   * Applies a delta as it's fed, one command at a time. The fixed-size fields
+   * of a command are gathered first; literal data is passed through as it
+   * comes.
+   */
+  class cdc_patch_context : public delta_codec::context
+  {
+  public:
+    cdc_patch_context(char const* basis, size_t basis_size, std::ostream& target)
+    : basis_(basis),
+      basis_size_(basis_size),
+      target_(target),
+      state_(READ_MAGIC),
+      literal_left_(0),
+      result_(RS_BLOCKED)
+    {
+    }
+
+    virtual ~cdc_patch_context() {
+    }
+
+    virtual bool update(char const* data, size_t size) {
+      while (size > 0 && result_ == RS_BLOCKED) {
+        if (state_ == DONE) {
+          result_ = RS_CORRUPT; // trailing data after the end of the delta
+        }
+        else if (state_ == COPY_LITERAL) {
+          const size_t length = static_cast<size_t>(std::min<uint64_t>(literal_left_, size));
+
+          write(data, length);
+
+          data += length;
+          size -= length;
+          literal_left_ -= length;
+
+          if (literal_left_ == 0) {
+            state_ = READ_COMMAND;
+          }
+        }
+        else {
+          const size_t length = std::min(field_size() - field_.size(), size);
+
+          field_.append(data, length);
+
+          data += length;
+          size -= length;
+
+          if (field_.size() == field_size()) {
+            read_field();
+            field_.clear();
+          }
+        }
+      }
+
+      return result_ == RS_BLOCKED;
+    }
+
+    virtual rs_result finish() {
+      if (result_ == RS_BLOCKED) {
+        result_ = state_ == DONE ? RS_DONE : RS_INPUT_ENDED;
+      }
+
+      return result_;
+    }
+
+  private:
+    enum state_t {
+      READ_MAGIC,
+      READ_COMMAND,
+      READ_COPY,
+      READ_LITERAL_LENGTH,
+      COPY_LITERAL,
+      DONE
+    };
+
+    size_t field_size() const {
+      switch (state_) {
+        case READ_MAGIC:          return 4;
+        case READ_COMMAND:        return 1;
+        case READ_COPY:           return 16;
+        case READ_LITERAL_LENGTH: return 8;
+        default:                  return 0;
+      }
+    }
+
+    void read_field() {
+      char const* field = field_.data();
+
+      switch (state_) {
+        case READ_MAGIC:
+          if (get_uint(field, 4) != CDC_DELTA_MAGIC) {
+            result_ = RS_BAD_MAGIC;
+          }
+
+          state_ = READ_COMMAND;
+          break;
+
+        case READ_COMMAND:
+          switch (static_cast<unsigned char>(field[0])) {
+            case CDC_OP_END:      state_ = DONE; break;
+            case CDC_OP_COPY:     state_ = READ_COPY; break;
+            case CDC_OP_LITERAL:  state_ = READ_LITERAL_LENGTH; break;
+            default:              result_ = RS_CORRUPT; break;
+          }
+          break;
+
+        case READ_COPY: {
+          const uint64_t offset = get_uint(field, 8);
+          const uint64_t length = get_uint(field + 8, 8);
+
+          if (offset > basis_size_ || length > basis_size_ - offset) {
+            result_ = RS_CORRUPT; // refers past the end of the basis
+          }
+          else {
+            write(basis_ + offset, static_cast<size_t>(length));
+          }
+
+          state_ = READ_COMMAND;
+          break;
+        }
+
+        case READ_LITERAL_LENGTH:
+          literal_left_ = get_uint(field, 8);
+          state_ = literal_left_ > 0 ? COPY_LITERAL : READ_COMMAND;
+          break;
+
+        default:
+          break;
+      }
+    }
+
+    void write(char const* data, size_t size) {
+      if (!target_.write(data, size)) {
+        result_ = RS_IO_ERROR;
+      }
+    }
+
+    char const    *basis_;
+    uint64_t      basis_size_;
+    std::ostream  &target_;
+    state_t       state_;
+    string_t      field_;
+    uint64_t      literal_left_;
+    rs_result     result_;
+  };
+
+  cdc_encoder::cdc_encoder(size_t average_chunk_size, int concurrency)
+  : delta_codec("cdc"),
+    logger("delta_encoder[cdc]"),
+    average_chunk_size_(average_chunk_size),
+    concurrency_(concurrency)
+  {
+    if (!is_valid_average_size(average_chunk_size)) {
+      throw invalid_state("chunk size must be a power of two between 256 bytes and 1 MiB");
+    }
+  }
+
+  cdc_encoder::~cdc_encoder() {
+  }
+
+  rs_result cdc_encoder::signature(std::istream& basis, std::ostream& signature) const
+  {
+    const chunker_t chunker(static_cast<uint32_t>(average_chunk_size_));
+    const worker_pool workers(concurrency_);
+    string_t header;
+
+    put_u32(header, CDC_SIGNATURE_MAGIC);
+    put_u32(header, chunker.min_size);
+    put_u32(header, chunker.average_size);
+    put_u32(header, chunker.max_size);
+
+    if (!signature.write(header.data(), header.size())) {
+      return RS_IO_ERROR;
+    }
+
+    rs_result result = for_each_chunk(basis, chunker, workers, [&](char const*, std::vector<chunk_t> const& chunks) {
+      string_t entries;
+
+      entries.reserve(chunks.size() * SIGNATURE_ENTRY_SIZE);
+
+      for (auto const& chunk : chunks) {
+        put_u32(entries, static_cast<uint32_t>(chunk.length));
+        put_u64(entries, chunk.digest.high);
+        put_u64(entries, chunk.digest.low);
+      }
+
+      return !!signature.write(entries.data(), entries.size());
+    });
+
+    return result == RS_INTERNAL_ERROR ? RS_IO_ERROR : result;
+  }
+
+  rs_result cdc_encoder::delta(std::istream& signature_in, std::istream& new_file, std::ostream& delta) const
+  {
+    const string_t signature(
+      (std::istreambuf_iterator<char>(signature_in)),
+      std::istreambuf_iterator<char>()
+    );
+
+    if (signature_in.bad()) {
+      return RS_IO_ERROR;
+    }
+
+    if (signature.size() < SIGNATURE_HEADER_SIZE || get_uint(signature.data(), 4) != CDC_SIGNATURE_MAGIC) {
+      error() << "Not a CDC signature";
+      return RS_BAD_MAGIC;
+    }
+
+    const uint64_t average_size = get_uint(signature.data() + 8, 4);
+
+    if (!is_valid_average_size(average_size)) {
+      error() << "CDC signature has an invalid chunk size: " << average_size;
+      return RS_CORRUPT;
+    }
+
+    const chunker_t chunker(static_cast<uint32_t>(average_size));
+
+    if (
+      get_uint(signature.data() + 4, 4) != chunker.min_size ||
+      get_uint(signature.data() + 12, 4) != chunker.max_size ||
+      (signature.size() - SIGNATURE_HEADER_SIZE) % SIGNATURE_ENTRY_SIZE != 0
+    ) {
+      error() << "CDC signature is corrupt";
+      return RS_CORRUPT;
+    }
+
+    // where in the basis every distinct chunk is first found
+    std::unordered_map<digest_t, uint64_t, digest_hash_t> basis_chunks;
+    uint64_t basis_offset = 0;
+
+    basis_chunks.reserve((signature.size() - SIGNATURE_HEADER_SIZE) / SIGNATURE_ENTRY_SIZE);
+
+    for (size_t i = SIGNATURE_HEADER_SIZE; i < signature.size(); i += SIGNATURE_ENTRY_SIZE) {
+      digest_t digest;
+
+      digest.high = get_uint(signature.data() + i + 4, 8);
+      digest.low = get_uint(signature.data() + i + 12, 8);
+
+      basis_chunks.insert(std::make_pair(digest, basis_offset));
+      basis_offset += get_uint(signature.data() + i, 4);
+    }
+
+    const worker_pool workers(concurrency_);
+    delta_writer writer(delta);
+
+    rs_result result = for_each_chunk(new_file, chunker, workers, [&](char const* data, std::vector<chunk_t> const& chunks) {
+      for (auto const& chunk : chunks) {
+        auto match = basis_chunks.find(chunk.digest);
+
+        if (match != basis_chunks.end()) {
+          writer.copy(match->second, chunk.length);
+        }
+        else {
+          writer.literal(data + chunk.offset, chunk.length);
+        }
+      }
+
+      return !delta.fail();
+    });
+
+    if (result == RS_DONE && !writer.end()) {
+      result = RS_IO_ERROR;
+    }
+
+    return result == RS_INTERNAL_ERROR ? RS_IO_ERROR : result;
+  }
+
+  std::unique_ptr<delta_codec::context>
+  cdc_encoder::begin_patch(char const* basis, size_t basis_size, std::ostream& target) const
+  {
+    return std::unique_ptr<context>(new cdc_patch_context(basis, basis_size, target));
+  }
+}
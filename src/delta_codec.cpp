@@ -0,0 +1,139 @@
+/**
+ * karazeh -- the library for patching software
+ *
+ * Copyright (C) 2011-2016 by Ahmad Amireh <ahmad@amireh.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#include "karazeh/delta_codec.hpp"
+#include "karazeh/delta_encoder.hpp"
+#include "karazeh/cdc_encoder.hpp"
+#include "karazeh/file_manager.hpp"
+#include <fstream>
+#include <vector>
+
+namespace kzh {
+
+  /** size of the blocks a delta is read from a stream in */
+  static const size_t PATCH_BUFFER_SIZE = 256 * 1024;
+
+  rs_result delta_codec::patch(char const* basis, size_t basis_size, std::istream& delta, std::ostream& target) const
+  {
+    std::unique_ptr<context> patch(begin_patch(basis, basis_size, target));
+    std::vector<char> buffer(PATCH_BUFFER_SIZE);
+
+    while (delta.read(&buffer[0], buffer.size()) || delta.gcount() > 0) {
+      if (!patch->update(&buffer[0], static_cast<size_t>(delta.gcount()))) {
+        break;
+      }
+    }
+
+    if (delta.bad()) {
+      return RS_IO_ERROR;
+    }
+
+    return patch->finish();
+  }
+
+  rs_result delta_codec::patch(path_t const& basis_path, path_t const& delta_path, path_t const& out_path) const
+  {
+    const file_manager files;
+    std::unique_ptr<mapped_file> basis(files.map_file(basis_path));
+    std::unique_ptr<mapped_file> delta(files.map_file(delta_path));
+
+    if (!basis || !delta) {
+      return RS_IO_ERROR;
+    }
+
+    std::ofstream out(out_path.string().c_str(), std::ios_base::binary | std::ios_base::trunc);
+    std::unique_ptr<context> patch(begin_patch(basis->data(), basis->size(), out));
+
+    patch->update(delta->data(), delta->size());
+
+    rs_result result = patch->finish();
+
+    out.close();
+
+    if (result == RS_DONE && out.fail()) {
+      result = RS_IO_ERROR;
+    }
+
+    return result;
+  }
+
+  delta_codec const* delta_codec::find(string_t const& name) {
+    static const delta_encoder rsync;
+    static const cdc_encoder cdc;
+
+    static const delta_codec* codecs[] = { &rsync, &cdc };
+
+    for (auto candidate : codecs) {
+      if (candidate->name() == name) {
+        return candidate;
+      }
+    }
+
+    return nullptr;
+  }
+
+  /**
+   * Feeds whatever is written to it into a patch context. There's no put
+   * area, every write goes straight to the patch.
+   */
+  class patch_stream::patch_buffer : public std::streambuf
+  {
+  public:
+    explicit patch_buffer(std::unique_ptr<delta_codec::context> patch)
+    : patch_(std::move(patch))
+    {
+    }
+
+    rs_result finish() {
+      return patch_->finish();
+    }
+
+  protected:
+    virtual std::streamsize xsputn(char const* data, std::streamsize size) {
+      return patch_->update(data, static_cast<size_t>(size)) ? size : 0;
+    }
+
+    virtual int_type overflow(int_type c) {
+      if (traits_type::eq_int_type(c, traits_type::eof())) {
+        return traits_type::not_eof(c);
+      }
+
+      const char ch = traits_type::to_char_type(c);
+
+      return patch_->update(&ch, 1) ? c : traits_type::eof();
+    }
+
+  private:
+    std::unique_ptr<delta_codec::context> patch_;
+  };
+
+  patch_stream::patch_stream(std::unique_ptr<delta_codec::context> patch)
+  : std::ostream(NULL),
+    buffer_(new patch_buffer(std::move(patch)))
+  {
+    rdbuf(buffer_.get());
+  }
+
+  patch_stream::~patch_stream() {
+  }
+
+  rs_result patch_stream::finish() {
+    return buffer_->finish();
+  }
+}
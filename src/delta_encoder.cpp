@@ -19,21 +19,189 @@
  */
 
 #include "karazeh/delta_encoder.hpp"
+#include "karazeh/worker_pool.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+extern "C" {
+  #include "librsync-2.0.0/src/sumset.h"
+}
 
 namespace kzh {
 
-  static size_t block_len = RS_DEFAULT_BLOCK_LEN;
-  static size_t strong_len = RS_MAX_STRONG_SUM_LENGTH;
+  /** size of the blocks streamed into and out of librsync jobs */
+  static const size_t JOB_BUFFER_SIZE = 256 * 1024;
+
+  typedef struct {
+    char const  *data;
+    size_t      size;
+  } basis_buffer_t;
+
+  /**
+   * Serves the parts of an in-memory basis that librsync asks for, pointing
+   * it straight into the buffer instead of copying them into its own.
+   */
+  static rs_result
+  copy_from_basis_buffer(void *opaque, rs_long_t pos, size_t *len, void **buf)
+  {
+    basis_buffer_t const *basis = static_cast<basis_buffer_t const*>(opaque);
+
+    if (pos < 0 || static_cast<uint64_t>(pos) >= basis->size) {
+      return RS_INPUT_ENDED;
+    }
+
+    *len = std::min(*len, basis->size - static_cast<size_t>(pos));
+    *buf = const_cast<char*>(basis->data + pos);
+
+    return RS_DONE;
+  }
+
+  /**
+   * Runs a librsync job to completion through rs_job_iter().
+   *
+   * Input is read from @in in blocks, or taken from @in_data as a whole when
+   * @in is NULL. Whatever the job produces is written to @out, which may be
+   * NULL for jobs that produce nothing (like loading a signature.)
+   */
+  static rs_result run_job(
+    rs_job_t      *job,
+    std::istream  *in,
+    char const    *in_data,
+    size_t        in_size,
+    std::ostream  *out)
+  {
+    rs_buffers_t        buffers;
+    rs_result           result;
+    std::vector<char>   in_buffer(in ? JOB_BUFFER_SIZE : 0);
+    std::vector<char>   out_buffer(out ? JOB_BUFFER_SIZE : 0);
+
+    std::memset(&buffers, 0, sizeof(buffers));
+
+    if (!in) {
+      buffers.next_in = const_cast<char*>(in_data);
+      buffers.avail_in = in_size;
+      buffers.eof_in = 1;
+    }
+
+    do {
+      if (in && !buffers.eof_in) {
+        // keep whatever the job didn't consume yet and top the buffer up
+        if (buffers.avail_in > 0 && buffers.next_in != &in_buffer[0]) {
+          std::memmove(&in_buffer[0], buffers.next_in, buffers.avail_in);
+        }
+
+        in->read(&in_buffer[buffers.avail_in], in_buffer.size() - buffers.avail_in);
+
+        if (in->bad()) {
+          return RS_IO_ERROR;
+        }
+
+        buffers.next_in = &in_buffer[0];
+        buffers.avail_in += static_cast<size_t>(in->gcount());
+        buffers.eof_in = in->eof() ? 1 : 0;
+      }
+
+      buffers.next_out = out ? &out_buffer[0] : NULL;
+      buffers.avail_out = out_buffer.size();
+
+      result = rs_job_iter(job, &buffers);
+
+      if (result != RS_DONE && result != RS_BLOCKED) {
+        break;
+      }
+
+      const size_t produced = out_buffer.size() - buffers.avail_out;
+
+      if (produced > 0 && !out->write(&out_buffer[0], produced)) {
+        result = RS_IO_ERROR;
+      }
+    } while (result == RS_BLOCKED);
+
+    return result;
+  }
+
+  /**
+   * Loads a signature from a stream and indexes it for searching. On success
+   * the caller owns @sumset and must rs_free_sumset() it.
+   */
+  static rs_result load_signature(std::istream& signature, rs_signature_t **sumset)
+  {
+    rs_job_t  *job = rs_loadsig_begin(sumset);
+    rs_result result = run_job(job, &signature, NULL, 0, NULL);
+
+    rs_job_free(job);
+
+    if (result == RS_DONE) {
+      result = rs_build_hash_table(*sumset);
+    }
+
+    if (result != RS_DONE && *sumset) {
+      rs_free_sumset(*sumset);
+      *sumset = NULL;
+    }
+
+    return result;
+  }
+
+  /** smallest region of a new file that delta() searches on a thread of its own */
+  static const size_t MIN_DELTA_REGION_SIZE = 64 * 1024 * 1024;
+
+  /** size of the command that opens a delta, and of the one that ends it */
+  static const size_t DELTA_HEADER_SIZE = 4;
+  static const size_t DELTA_END_SIZE = 1;
+
+  /** block lengths picked by signature_options_t::for_size() are multiples of this */
+  static const size_t BLOCK_LENGTH_ALIGNMENT = 128;
+
+  signature_options_t signature_options_t::for_size(uint64_t size)
+  {
+    size_t block_length = static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(size))));
+
+    block_length = (block_length + BLOCK_LENGTH_ALIGNMENT - 1) / BLOCK_LENGTH_ALIGNMENT * BLOCK_LENGTH_ALIGNMENT;
+
+    return signature_options_t(
+      std::max<size_t>(block_length, RS_DEFAULT_BLOCK_LEN),
+      RS_MAX_STRONG_SUM_LENGTH
+    );
+  }
+
+  static void validate_signature_options(signature_options_t const& options)
+  {
+    if (options.block_length == 0) {
+      throw invalid_state("signature block length must be greater than 0");
+    }
+    if (options.strong_length == 0 || options.strong_length > RS_MAX_STRONG_SUM_LENGTH) {
+      throw invalid_state("signature strong sum length is out of range");
+    }
+  }
 
   delta_encoder::delta_encoder()
-  : logger("delta_encoder[rdiff]")
+  : delta_codec("rsync"),
+    logger("delta_encoder[rdiff]")
   {
   }
 
   delta_encoder::~delta_encoder() {
   }
 
-  rs_result delta_encoder::signature(path_t const& basis_path, path_t const& sig_path)
+  rs_result delta_encoder::signature(path_t const& basis_path, path_t const& sig_path) const
+  {
+    if (!file_manager_.is_readable(basis_path)) {
+      throw invalid_resource("no such basis for signature: " + basis_path.string());
+    }
+
+    return signature(
+      basis_path,
+      sig_path,
+      signature_options_t::for_size(file_manager_.stat_filesize(basis_path))
+    );
+  }
+
+  rs_result delta_encoder::signature(path_t const& basis_path, path_t const& sig_path, signature_options_t const& options) const
   {
     FILE            *basis_file, *sig_file;
     rs_stats_t      stats;
@@ -46,10 +214,19 @@ namespace kzh {
       throw invalid_state("signature destination is not writable: " + sig_path.string());
     }
 
+    validate_signature_options(options);
+
     basis_file  = rs_file_open(basis_path.string().c_str(), "rb");
     sig_file    = rs_file_open(sig_path.string().c_str(), "wb");
 
-    result = rs_sig_file(basis_file, sig_file, block_len, strong_len, RS_BLAKE2_SIG_MAGIC, &stats);
+    result = rs_sig_file(
+      basis_file,
+      sig_file,
+      options.block_length,
+      options.strong_length,
+      RS_BLAKE2_SIG_MAGIC,
+      &stats
+    );
 
     rs_file_close(sig_file);
     rs_file_close(basis_file);
@@ -61,7 +238,7 @@ namespace kzh {
   }
 
 
-  rs_result delta_encoder::delta(path_t const& sig_path, path_t const &file_path, path_t const& delta_path)
+  rs_result delta_encoder::delta(path_t const& sig_path, path_t const &file_path, path_t const& delta_path) const
   {
     FILE            *sig_file, *new_file, *delta_file;
     rs_result       result;
@@ -100,7 +277,43 @@ namespace kzh {
     return result;
   }
 
-  rs_result delta_encoder::patch(path_t const& basis_path, path_t const& delta_path, path_t const& out_path)
+  rs_result delta_encoder::delta(
+    path_t const& sig_path,
+    path_t const& file_path,
+    path_t const& delta_path,
+    int concurrency) const
+  {
+    if (!file_manager_.is_readable(sig_path)) {
+      throw invalid_resource("signature file is unreadable: " + sig_path.string());
+    }
+    if (!file_manager_.is_readable(file_path)) {
+      throw invalid_resource("reference file is unreadable: " + file_path.string());
+    }
+    if (!file_manager_.is_writable(delta_path)) {
+      throw invalid_state("delta destination is not writable: " + delta_path.string());
+    }
+
+    std::unique_ptr<mapped_file> new_file(file_manager_.map_file(file_path));
+
+    if (!new_file) {
+      return delta(sig_path, file_path, delta_path);
+    }
+
+    std::ifstream signature(sig_path.string().c_str(), std::ios_base::binary);
+    std::ofstream out(delta_path.string().c_str(), std::ios_base::binary | std::ios_base::trunc);
+    rs_result result = delta(signature, new_file->data(), new_file->size(), out, concurrency);
+
+    out.close();
+
+    if (result == RS_DONE && out.fail()) {
+      error() << "Unable to write delta " << delta_path;
+      result = RS_IO_ERROR;
+    }
+
+    return result;
+  }
+
+  rs_result delta_encoder::patch(path_t const& basis_path, path_t const& delta_path, path_t const& out_path) const
   {
     // patch BASIS [DELTA [NEWFILE]]
     FILE               *basis_file, *delta_file, *new_file;
@@ -117,6 +330,13 @@ namespace kzh {
       throw invalid_state("target destination is not writable: " + out_path.string());
     }
 
+    std::unique_ptr<mapped_file> basis(file_manager_.map_file(basis_path));
+    std::unique_ptr<mapped_file> delta(file_manager_.map_file(delta_path));
+
+    if (basis && delta) {
+      return patch(*basis, *delta, out_path);
+    }
+
     basis_file = rs_file_open(basis_path.string().c_str(), "rb");
     delta_file = rs_file_open(delta_path.string().c_str(), "rb");
     new_file =   rs_file_open(out_path.string().c_str(), "wb");
@@ -129,4 +349,247 @@ namespace kzh {
 
     return result;
   }
-}
\ No newline at end of file
+
+  rs_result delta_encoder::patch(mapped_file const& basis, mapped_file const& delta, path_t const& out_path) const
+  {
+    std::ofstream out(out_path.string().c_str(), std::ios_base::binary | std::ios_base::trunc);
+    rs_result result = patch(basis.data(), basis.size(), delta.data(), delta.size(), out);
+
+    out.close();
+
+    if (result == RS_DONE && out.fail()) {
+      error() << "Unable to write patched file " << out_path;
+      result = RS_IO_ERROR;
+    }
+
+    return result;
+  }
+
+  rs_result delta_encoder::signature(std::istream& basis, std::ostream& signature) const
+  {
+    return this->signature(basis, signature, signature_options_t());
+  }
+
+  rs_result delta_encoder::signature(std::istream& basis, std::ostream& signature, signature_options_t const& options) const
+  {
+    validate_signature_options(options);
+
+    rs_job_t *job = rs_sig_begin(options.block_length, options.strong_length, RS_BLAKE2_SIG_MAGIC);
+    rs_result result = run_job(job, &basis, NULL, 0, &signature);
+
+    rs_job_free(job);
+
+    return result;
+  }
+
+  rs_result delta_encoder::delta(std::istream& signature, std::istream& new_file, std::ostream& delta) const
+  {
+    rs_signature_t  *sumset = NULL;
+    rs_result       result = load_signature(signature, &sumset);
+
+    if (result == RS_DONE) {
+      rs_job_t *job = rs_delta_begin(sumset);
+      result = run_job(job, &new_file, NULL, 0, &delta);
+      rs_job_free(job);
+      rs_free_sumset(sumset);
+    }
+
+    return result;
+  }
+
+  rs_result delta_encoder::delta(
+    std::istream& signature,
+    char const* new_file,
+    size_t new_file_size,
+    std::ostream& delta,
+    int concurrency) const
+  {
+    rs_signature_t  *sumset = NULL;
+    rs_result       result = load_signature(signature, &sumset);
+
+    if (result != RS_DONE) {
+      return result;
+    }
+
+    const worker_pool workers(concurrency);
+    const size_t wave_size = static_cast<size_t>(workers.size());
+    const size_t block_length = static_cast<size_t>(std::max(sumset->block_len, 1));
+
+    // as many regions as there are threads, unless that makes them too small
+    size_t region_size = std::max(MIN_DELTA_REGION_SIZE, (new_file_size + wave_size - 1) / wave_size);
+    region_size = (region_size + block_length - 1) / block_length * block_length;
+
+    const size_t region_count = std::max<size_t>((new_file_size + region_size - 1) / region_size, 1);
+
+    for (size_t first = 0; first < region_count && result == RS_DONE; first += wave_size) {
+      const size_t count = std::min(wave_size, region_count - first);
+      std::vector<string_t> deltas(count);
+      std::vector<rs_result> results(count, RS_DONE);
+
+      workers.run(count, [&](size_t i) {
+        const size_t offset = (first + i) * region_size;
+        const size_t size = std::min(region_size, new_file_size - std::min(offset, new_file_size));
+        std::ostringstream region_delta;
+        rs_job_t *job = rs_delta_begin(sumset);
+
+        results[i] = run_job(job, NULL, new_file + offset, size, &region_delta);
+        rs_job_free(job);
+
+        deltas[i] = region_delta.str();
+
+        return results[i] == RS_DONE;
+      });
+
+      for (size_t i = 0; i < count && result == RS_DONE; ++i) {
+        const size_t region = first + i;
+        const bool first_region = region == 0;
+        const bool last_region = region + 1 == region_count;
+        string_t const& region_delta = deltas[i];
+
+        result = results[i];
+
+        if (result != RS_DONE) {
+          error() << "Unable to generate the delta of region " << region << ", librsync rc: " << result;
+          break;
+        }
+
+        if (region_delta.size() < DELTA_HEADER_SIZE + DELTA_END_SIZE) {
+          result = RS_INTERNAL_ERROR;
+          break;
+        }
+
+        const size_t begin = first_region ? 0 : DELTA_HEADER_SIZE;
+        const size_t end = region_delta.size() - (last_region ? 0 : DELTA_END_SIZE);
+
+        if (!delta.write(region_delta.data() + begin, end - begin)) {
+          result = RS_IO_ERROR;
+        }
+      }
+    }
+
+    rs_free_sumset(sumset);
+
+    return result;
+  }
+
+  rs_result delta_encoder::patch(
+    char const* basis,
+    size_t basis_size,
+    std::istream& delta,
+    std::ostream& target) const
+  {
+    basis_buffer_t buffer = { basis, basis_size };
+    rs_job_t *job = rs_patch_begin(copy_from_basis_buffer, &buffer);
+    rs_result result = run_job(job, &delta, NULL, 0, &target);
+
+    rs_job_free(job);
+
+    return result;
+  }
+
+  rs_result delta_encoder::patch(
+    char const* basis,
+    size_t basis_size,
+    char const* delta,
+    size_t delta_size,
+    std::ostream& target) const
+  {
+    basis_buffer_t buffer = { basis, basis_size };
+    rs_job_t *job = rs_patch_begin(copy_from_basis_buffer, &buffer);
+    rs_result result = run_job(job, NULL, delta, delta_size, &target);
+
+    rs_job_free(job);
+
+    return result;
+  }
+
+  /**
+   * Feeds the delta into an rs_patch job, writing out whatever it patches as
+   * it goes.
+   */
+  class rsync_patch_context : public delta_codec::context
+  {
+  public:
+    rsync_patch_context(char const* basis, size_t basis_size, std::ostream& target)
+    : target_(target),
+      out_buffer_(JOB_BUFFER_SIZE),
+      result_(RS_BLOCKED)
+    {
+      basis_.data = basis;
+      basis_.size = basis_size;
+
+      job_ = rs_patch_begin(copy_from_basis_buffer, &basis_);
+    }
+
+    virtual ~rsync_patch_context() {
+      rs_job_free(job_);
+    }
+
+    virtual bool update(char const* data, size_t size) {
+      return feed(data, size, false);
+    }
+
+    virtual rs_result finish() {
+      if (result_ == RS_BLOCKED) {
+        feed(NULL, 0, true);
+      }
+
+      return result_;
+    }
+
+  private:
+    /**
+     * Runs the job until it has taken all of @data in, or until it's done if
+     * this is the end of the delta.
+     */
+    bool feed(char const* data, size_t size, bool eof) {
+      rs_buffers_t buffers;
+
+      if (result_ != RS_BLOCKED) {
+        return false; // done, or failed, already
+      }
+
+      std::memset(&buffers, 0, sizeof(buffers));
+
+      buffers.next_in = const_cast<char*>(data);
+      buffers.avail_in = size;
+      buffers.eof_in = eof ? 1 : 0;
+
+      do {
+        buffers.next_out = &out_buffer_[0];
+        buffers.avail_out = out_buffer_.size();
+
+        result_ = rs_job_iter(job_, &buffers);
+
+        const size_t produced = out_buffer_.size() - buffers.avail_out;
+
+        if (produced > 0 && !target_.write(&out_buffer_[0], produced)) {
+          result_ = RS_IO_ERROR;
+        }
+
+        if (result_ == RS_DONE && !eof && buffers.avail_in > 0) {
+          result_ = RS_CORRUPT; // trailing data after the end of the delta
+        }
+      } while (result_ == RS_BLOCKED && (eof || buffers.avail_in > 0));
+
+      return result_ == RS_BLOCKED || result_ == RS_DONE;
+    }
+
+    basis_buffer_t      basis_;
+    std::ostream        &target_;
+    std::vector<char>   out_buffer_;
+    rs_job_t            *job_;
+    rs_result           result_;
+  };
+
+  std::unique_ptr<delta_codec::context>
+  delta_encoder::begin_patch(char const* basis, size_t basis_size, std::ostream& target) const
+  {
+    return std::unique_ptr<context>(new rsync_patch_context(basis, basis_size, target));
+  }
+
+  patch_stream::patch_stream(char const* basis, size_t basis_size, std::ostream& target)
+  : patch_stream(std::unique_ptr<delta_codec::context>(new rsync_patch_context(basis, basis_size, target)))
+  {
+  }
+}
@@ -0,0 +1,265 @@
+/**
+ * karazeh -- the library for patching software
+ *
+ * Copyright (C) 2011-2016 by Ahmad Amireh <ahmad@amireh.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#include "karazeh/digest_cache.hpp"
+#include "karazeh/file_manager.hpp"
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <sstream>
+
+#ifndef _WIN32
+  #include <sys/stat.h>
+#endif
+
+namespace fs = boost::filesystem;
+
+namespace kzh {
+
+  const char* const digest_cache::FILE_NAME = "digests";
+
+  /** first line of the cache file, bumped whenever the format changes */
+  static const string_t CACHE_FILE_HEADER = "karazeh-digest-cache 1";
+
+  digest_cache::digest_cache(path_t const& path)
+  : logger("digest_cache"),
+    path_(path),
+    dirty_(false)
+  {
+  }
+
+  digest_cache::~digest_cache() {
+  }
+
+  bool digest_cache::stat(path_t const& path, entry_t& entry) {
+    #ifndef _WIN32
+      struct ::stat info;
+
+      if (::stat(path.string().c_str(), &info) != 0 || !S_ISREG(info.st_mode)) {
+        return false;
+      }
+
+      #ifdef __APPLE__
+        const struct timespec &mtime = info.st_mtimespec;
+      #else
+        const struct timespec &mtime = info.st_mtim;
+      #endif
+
+      entry.size = static_cast<uint64_t>(info.st_size);
+      entry.mtime = static_cast<uint64_t>(mtime.tv_sec) * 1000000000ull + static_cast<uint64_t>(mtime.tv_nsec);
+      entry.inode = static_cast<uint64_t>(info.st_ino);
+    #else
+      boost::system::error_code ec;
+
+      entry.size = fs::file_size(path, ec);
+
+      if (ec) {
+        return false;
+      }
+
+      entry.mtime = static_cast<uint64_t>(fs::last_write_time(path, ec)) * 1000000000ull;
+      entry.inode = 0;
+
+      if (ec) {
+        return false;
+      }
+    #endif
+
+    return true;
+  }
+
+  string_t digest_cache::key_of(hasher const& hasher, path_t const& path) {
+    return hasher.name() + '\t' + file_manager::normalize(path).string();
+  }
+
+  bool digest_cache::load() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::ifstream in(path_.string().c_str());
+    string_t line;
+
+    entries_.clear();
+    dirty_ = false;
+
+    if (!in.is_open()) {
+      return false;
+    }
+
+    if (!std::getline(in, line) || line != CACHE_FILE_HEADER) {
+      warn() << "Ignoring digest cache " << path_ << ", it was written by another version";
+      return false;
+    }
+
+    // hasher, size, mtime, inode, digest, and path, separated by tabs
+    while (std::getline(in, line)) {
+      size_t fields[5];
+      size_t offset = 0;
+      bool valid = true;
+
+      for (size_t i = 0; i < 5 && valid; ++i) {
+        fields[i] = line.find('\t', offset);
+        valid = fields[i] != string_t::npos;
+        offset = fields[i] + 1;
+      }
+
+      entry_t entry;
+      std::istringstream numbers(valid ? line.substr(fields[0] + 1, fields[3] - fields[0] - 1) : "");
+
+      if (!valid || !(numbers >> entry.size >> entry.mtime >> entry.inode)) {
+        error() << "Digest cache " << path_ << " is malformed, ignoring it";
+        entries_.clear();
+        return false;
+      }
+
+      entry.digest = line.substr(fields[3] + 1, fields[4] - fields[3] - 1);
+      entries_[line.substr(0, fields[0]) + '\t' + line.substr(fields[4] + 1)] = entry;
+    }
+
+    return true;
+  }
+
+  bool digest_cache::save() {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (!dirty_) {
+      return true;
+    }
+
+    const path_t temp_path(path_.string() + ".tmp");
+    boost::system::error_code ec;
+
+    fs::create_directories(path_.parent_path(), ec);
+
+    std::ofstream out(temp_path.string().c_str(), std::ios_base::trunc);
+
+    out << CACHE_FILE_HEADER << '\n';
+
+    for (auto const& pair : entries_) {
+      const size_t separator = pair.first.find('\t');
+      entry_t const& entry = pair.second;
+
+      if (entry.digest.empty()) {
+        continue;
+      }
+
+      out
+        << pair.first.substr(0, separator) << '\t'
+        << entry.size << '\t' << entry.mtime << '\t' << entry.inode << '\t'
+        << entry.digest << '\t'
+        << pair.first.substr(separator + 1) << '\n';
+    }
+
+    out.close();
+
+    if (out.fail()) {
+      error() << "Unable to write digest cache " << temp_path;
+      fs::remove(temp_path, ec);
+      return false;
+    }
+
+    fs::rename(temp_path, path_, ec);
+
+    if (ec) {
+      error() << "Unable to move digest cache into " << path_ << ": " << ec.message();
+      fs::remove(temp_path, ec);
+      return false;
+    }
+
+    dirty_ = false;
+
+    return true;
+  }
+
+  hasher::digest_rc digest_cache::hex_digest(hasher const& hasher, path_t const& path) {
+    const string_t key(key_of(hasher, path));
+    entry_t entry;
+
+    if (!stat(path, entry)) {
+      return hasher.hex_digest(path);
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto cached = entries_.find(key);
+
+      if (
+        cached != entries_.end() &&
+        !cached->second.digest.empty() &&
+        cached->second.size == entry.size &&
+        cached->second.mtime == entry.mtime &&
+        cached->second.inode == entry.inode
+      ) {
+        hasher::digest_rc rc;
+
+        rc.valid = true;
+        rc.digest = cached->second.digest;
+
+        return rc;
+      }
+    }
+
+    // digest outside of the lock so that files can be digested in parallel;
+    // the metadata is the one from before, so a file that changes meanwhile
+    // is digested again next time
+    hasher::digest_rc rc = hasher.hex_digest(path);
+
+    if (rc.valid) {
+      std::lock_guard<std::mutex> lock(mutex_);
+
+      entry.digest = rc.digest;
+      entries_[key] = entry;
+      dirty_ = true;
+    }
+
+    return rc;
+  }
+
+  void digest_cache::refresh(hasher const& hasher, path_t const& path, string_t const& digest) {
+    const string_t key(key_of(hasher, path));
+    entry_t entry;
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto cached = entries_.find(key);
+
+    if (cached == entries_.end()) {
+      return;
+    }
+
+    if (stat(path, entry)) {
+      entry.digest = digest;
+      cached->second = entry;
+    }
+    else {
+      entries_.erase(cached);
+    }
+
+    dirty_ = true;
+  }
+
+  void digest_cache::remove(path_t const& path) {
+    const string_t normal_path(file_manager::normalize(path).string());
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+      // keep the key around so that a file that's created again later in the
+      // same release is still refreshed; these aren't saved
+      if (it->first.compare(it->first.find('\t') + 1, string_t::npos, normal_path) == 0) {
+        it->second = entry_t();
+        dirty_ = true;
+      }
+    }
+  }
+}
@@ -19,22 +19,163 @@
  */
 
 #include "karazeh/downloader.hpp"
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <vector>
 
 namespace kzh {
+  /**
+   * How many of the bytes already received are requested again when resuming
+   * a download, to make sure the server is sending the same file and the
+   * local copy did not end in a corrupt chunk.
+   */
+  static const uint64_t RESUME_OVERLAP = 64 * 1024;
+
+  /** A download queued by downloader::fetch_async() */
+  struct async_download_t {
+    async_download_t(download_job_t const& in_job, downloader::async_callback_t const& in_callback, url_t const& url)
+    : job(in_job),
+      callback(in_callback),
+      download(url),
+      handle(nullptr),
+      attempt(0),
+      succeeded(false)
+    {
+      download.stream = &file;
+      curlerr[0] = '\0';
+    }
+
+    download_job_t                    job;
+    downloader::async_callback_t      callback;
+    download_t                        download;
+    std::ofstream                     file;
+    std::unique_ptr<hasher::context>  digest;
+    CURL                              *handle;
+    int                               attempt;
+    bool                              succeeded;
+    char                              curlerr[CURL_ERROR_SIZE];
+  };
+
+  /**
+   * Idle CURL handles kept around for re-use, along with the share handle they
+   * use to pool connections, DNS lookups and TLS sessions.
+   *
+   * Also tracks the state of the asynchronous downloads.
+   */
+  struct connection_pool {
+    std::mutex          mutex;
+    std::mutex          share_locks[CURL_LOCK_DATA_LAST];
+    CURLSH              *share;
+    std::vector<CURL*>  idle;
+
+    std::mutex                      multi_mutex;
+    CURLM                           *multi;
+    std::deque<async_download_t*>   queued;
+    std::vector<async_download_t*>  active;
+
+    connection_pool() : share(nullptr), multi(nullptr) {}
+  };
+
+  static void
+  on_curl_share_lock(CURL*, curl_lock_data data, curl_lock_access, void *userptr)
+  {
+    static_cast<connection_pool*>(userptr)->share_locks[data].lock();
+  }
+
+  static void
+  on_curl_share_unlock(CURL*, curl_lock_data data, void *userptr)
+  {
+    static_cast<connection_pool*>(userptr)->share_locks[data].unlock();
+  }
+
+  static CURL*
+  acquire_handle(connection_pool *pool)
+  {
+    CURL *handle = nullptr;
+
+    {
+      std::lock_guard<std::mutex> lock(pool->mutex);
+
+      // the share is set up lazily so that it is created after the
+      // application had a chance to call curl_global_init()
+      if (!pool->share && (pool->share = curl_share_init()) != nullptr) {
+        curl_share_setopt(pool->share, CURLSHOPT_LOCKFUNC, &on_curl_share_lock);
+        curl_share_setopt(pool->share, CURLSHOPT_UNLOCKFUNC, &on_curl_share_unlock);
+        curl_share_setopt(pool->share, CURLSHOPT_USERDATA, pool);
+        curl_share_setopt(pool->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+        curl_share_setopt(pool->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+        #if LIBCURL_VERSION_NUM >= 0x073900
+          curl_share_setopt(pool->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+        #endif
+      }
+
+      if (!pool->idle.empty()) {
+        handle = pool->idle.back();
+        pool->idle.pop_back();
+      }
+    }
+
+    if (!handle && (handle = curl_easy_init()) == nullptr) {
+      return nullptr;
+    }
+
+    if (pool->share) {
+      curl_easy_setopt(handle, CURLOPT_SHARE, pool->share);
+    }
+
+    // we may be running on any number of threads
+    curl_easy_setopt(handle, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(handle, CURLOPT_TCP_KEEPALIVE, 1L);
+
+    return handle;
+  }
+
+  static void
+  release_handle(connection_pool *pool, CURL *handle)
+  {
+    // resetting the options keeps the handle's live connections and caches
+    curl_easy_reset(handle);
+
+    std::lock_guard<std::mutex> lock(pool->mutex);
+    pool->idle.push_back(handle);
+  }
+
   static size_t
   on_curl_data(char *buffer, size_t size, size_t nmemb, void *userdata)
   {
     download_t *download = static_cast<download_t*>(userdata);
-    size_t realsize = size * nmemb;
+    const size_t realsize = size * nmemb;
+    size_t length = realsize;
+
+    if (!download->overlap.empty()) {
+      const size_t overlap = std::min(length, download->overlap.size());
 
-    if (download->stream) {
-      download->stream->write(buffer, realsize);
+      if (std::memcmp(buffer, download->overlap.data(), overlap) != 0) {
+        download->overlap_mismatch = true;
+        return 0; // aborts the transfer
+      }
+
+      download->overlap.erase(0, overlap);
+      buffer += overlap;
+      length -= overlap;
+    }
+
+    if (download->stream && !download->stream->write(buffer, length)) {
+      return 0; // aborts the transfer
     }
 
     if (download->buf) {
-      (*download->buf) += string_t(buffer, realsize);
+      (*download->buf) += string_t(buffer, length);
+    }
+
+    if (download->digest) {
+      download->digest->update(buffer, length);
     }
 
+    download->received += length;
+
     return realsize;
   }
 
@@ -42,11 +183,36 @@ namespace kzh {
   : logger("downloader"),
     config_(config),
     retry_count_(2),
-    file_manager_(fmgr)
+    max_async_transfers_(8),
+    file_manager_(fmgr),
+    connections_(new connection_pool())
   {
   }
 
   downloader::~downloader() {
+    for (auto transfer : connections_->active) {
+      curl_multi_remove_handle(connections_->multi, transfer->handle);
+      curl_easy_cleanup(transfer->handle);
+      delete transfer;
+    }
+
+    for (auto transfer : connections_->queued) {
+      delete transfer;
+    }
+
+    if (connections_->multi) {
+      curl_multi_cleanup(connections_->multi);
+    }
+
+    for (auto handle : connections_->idle) {
+      curl_easy_cleanup(handle);
+    }
+
+    if (connections_->share) {
+      curl_share_cleanup(connections_->share);
+    }
+
+    delete connections_;
   }
 
   void
@@ -59,12 +225,22 @@ namespace kzh {
     return retry_count_;
   }
 
+  void
+  downloader::set_max_async_transfers(int n) {
+    max_async_transfers_ = n > 0 ? n : 1;
+  }
+
+  int
+  downloader::max_async_transfers() const {
+    return max_async_transfers_;
+  }
+
   bool
   downloader::fetch_file(url_t const& url, download_t* download, bool assume_ownership) const
   {
-    CURL* curl_ = curl_easy_init();
+    CURL* curl_ = acquire_handle(connections_);
     CURLcode curlrc_;
-    bool http_connection_successful, http_request_successful;
+    bool successful;
 
     if (!curl_) {
       error() << "unable to resolve URL " << url << ", aborting remote download request";
@@ -80,30 +256,62 @@ namespace kzh {
     curl_easy_setopt(curl_, CURLOPT_WRITEFUNCTION, &on_curl_data);
     curl_easy_setopt(curl_, CURLOPT_WRITEDATA, download);
 
+    if (download->range_start > 0) {
+      curl_easy_setopt(curl_, CURLOPT_RESUME_FROM_LARGE, (curl_off_t)download->range_start);
+    }
+
     curlrc_ = curl_easy_perform(curl_);
-    http_connection_successful = curlrc_ == 0;
+    download->curlrc = curlrc_;
+    successful = verify_response(curl_, curlrc_, curlerr);
 
-    if (http_connection_successful) {
-      long http_rc = 0;
-      curl_easy_getinfo(curl_, CURLINFO_RESPONSE_CODE, &http_rc);
+    release_handle(connections_, curl_);
 
-      http_request_successful = http_rc == 200;
+    if (assume_ownership) {
+      delete download;
+    }
 
-      if (!http_request_successful) {
-        error() << "Remote server error; status code: " << http_rc;
-      }
+    return successful;
+  }
+
+  bool
+  downloader::verify_response(CURL* curl, CURLcode curlrc, char const* curlerr) const
+  {
+    if (curlrc != CURLE_OK) {
+      error() << "CURL connection error: " << curlrc << " => " << curlerr;
+      return false;
     }
-    else {
-      error() << "CURL connection error: " << curlrc_ << " => " << curlerr;
+
+    long http_rc = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_rc);
+
+    // 206 is what we get for ranged requests
+    if (http_rc != 200 && http_rc != 206) {
+      error() << "Remote server error; status code: " << http_rc;
+      return false;
     }
 
-    curl_easy_cleanup(curl_);
+    return true;
+  }
 
-    if (assume_ownership) {
-      delete download;
+  bool
+  downloader::verify_integrity(path_t const& path, string_t const& checksum, hasher::context* digest) const
+  {
+    if (!file_manager_.is_readable(path)) {
+      return false; // this really shouldn't happen, but oh well
     }
 
-    return http_connection_successful && http_request_successful;
+    // the digest has been fed while downloading
+    hasher::digest_rc rc = digest->finalize();
+
+    if (rc != checksum) {
+      warn()
+        << "Downloaded file integrity mismatch: "
+        <<  rc.digest << " vs " << checksum;
+
+      return false;
+    }
+
+    return true;
   }
 
   bool
@@ -129,8 +337,66 @@ namespace kzh {
   }
 
   bool
-  downloader::fetch(string_t const& url, path_t const& path, string_t const& checksum, int* const retry_tally) const
+  downloader::fetch(url_t const& _url, std::ostream& out_stream, string_t const& checksum, hasher const* hasher) const
+  {
+    const kzh::hasher *digest_hasher = hasher ? hasher : config_.hasher;
+    const url_t url(get_full_url(_url));
+    std::unique_ptr<hasher::context> digest(digest_hasher->begin());
+    download_t download(url);
+
+    download.stream = &out_stream;
+    download.digest = digest.get();
+
+    if (!fetch_file(url, &download, false)) {
+      return false;
+    }
+
+    hasher::digest_rc rc = digest->finalize();
+
+    if (rc != checksum) {
+      warn()
+        << "Downloaded file integrity mismatch: "
+        <<  rc.digest << " vs " << checksum;
+
+      return false;
+    }
+
+    return true;
+  }
+
+  /**
+   * Reads @length bytes starting at @offset of a partial download, provided
+   * the file is exactly @size bytes long.
+   */
+  static bool
+  read_partial_tail(path_t const& path, uint64_t size, uint64_t offset, uint64_t length, string_t& out_buf)
   {
+    boost::system::error_code ec;
+
+    if (boost::filesystem::file_size(path, ec) != size || ec) {
+      return false;
+    }
+
+    std::ifstream fp(path.string().c_str(), std::ios_base::in | std::ios_base::binary);
+
+    out_buf.resize(length);
+
+    if (!fp.seekg(offset) || !fp.read(&out_buf[0], length)) {
+      return false;
+    }
+
+    return true;
+  }
+
+  bool
+  downloader::fetch(string_t const& url, path_t const& path, string_t const& checksum, int* const retry_tally, hasher const* hasher) const
+  {
+    const kzh::hasher *digest_hasher = hasher ? hasher : config_.hasher;
+    const url_t full_url(get_full_url(url));
+    std::unique_ptr<hasher::context> digest;
+    uint64_t received = 0; // bytes of the partial download we may resume from
+    bool can_resume = true;
+
     // TODO: rethink about this, this really sounds like an external concern
     for (int i = 0; i < retry_count_ + 1; ++i) {
       bool fetch_successful;
@@ -140,40 +406,234 @@ namespace kzh {
         return false;
       }
 
-      std::ofstream fp(path.string().c_str(), std::ios_base::trunc | std::ios_base::binary);
-
       if (retry_tally != nullptr) {
         (*retry_tally) = i;
       }
 
-      fetch_successful = fetch(url, fp);
-
-      fp.close();
+      download_t download(full_url);
 
-      if (fetch_successful) {
-        if (!file_manager_.is_readable(path)) {
-          return false; // this really shouldn't happen, but oh well
-        }
+      if (received > 0) {
+        const uint64_t overlap = std::min(received, RESUME_OVERLAP);
 
-        // validate integrity
-        hasher::digest_rc rc = config_.hasher->hex_digest(path);
+        download.range_start = received - overlap;
 
-        if (rc == checksum) {
-          return true;
+        if (read_partial_tail(path, received, download.range_start, overlap, download.overlap)) {
+          notice() << "Resuming download of " << full_url << " from byte " << received;
         }
         else {
-          warn()
-            << "Downloaded file integrity mismatch: "
-            <<  rc.digest << " vs " << checksum;
+          download.range_start = 0;
+          download.overlap.clear();
+          received = 0;
         }
       }
 
+      const bool resuming = received > 0;
+
+      if (!resuming) {
+        digest = digest_hasher->begin();
+      }
+
+      std::ofstream fp(
+        path.string().c_str(),
+        (resuming ? std::ios_base::app : std::ios_base::trunc) | std::ios_base::binary
+      );
+
+      download.stream = &fp;
+      download.digest = digest.get();
+
+      fetch_successful = fetch_file(full_url, &download, false);
+
+      fp.close();
+
+      if (fp.fail()) {
+        error() << "Unable to write download to " << path;
+        fetch_successful = false;
+      }
+
+      if (fetch_successful && verify_integrity(path, checksum, digest.get())) {
+        return true;
+      }
+
+      if (download.curlrc == CURLE_RANGE_ERROR) {
+        warn() << "Server does not support range requests, downloads will not be resumed";
+        can_resume = false;
+      }
+      else if (download.overlap_mismatch) {
+        warn() << "Partial download of " << full_url << " does not match the remote file";
+      }
+
+      // only transfers that were cut short can be resumed, anything else
+      // (an HTTP error, a bad checksum, a mismatching overlap) means the data
+      // we have can not be trusted
+      const bool interrupted =
+        download.curlrc != CURLE_OK &&
+        download.curlrc != CURLE_WRITE_ERROR &&
+        download.curlrc != CURLE_RANGE_ERROR &&
+        !fp.fail();
+
+      if (can_resume && interrupted) {
+        received += download.received;
+      }
+      else {
+        received = 0;
+      }
+
       notice() << "Retry #" << i+1;
     }
 
     return false;
   }
 
+  void
+  downloader::fetch_async(download_job_t const& job, async_callback_t const& callback) const
+  {
+    auto transfer = new async_download_t(job, callback, get_full_url(job.url));
+
+    std::lock_guard<std::mutex> lock(connections_->multi_mutex);
+
+    connections_->queued.push_back(transfer);
+  }
+
+  void
+  downloader::start_async_transfers(std::vector<async_download_t*>& failed) const
+  {
+    connection_pool *pool = connections_;
+
+    while (
+      !pool->queued.empty() &&
+      pool->active.size() < static_cast<size_t>(max_async_transfers_)
+    ) {
+      async_download_t *transfer = pool->queued.front();
+      pool->queued.pop_front();
+
+      if (!file_manager_.is_writable(transfer->job.path)) {
+        error() << "Download destination is un-writable: " << transfer->job.path;
+        failed.push_back(transfer);
+        continue;
+      }
+
+      transfer->file.open(
+        transfer->job.path.string().c_str(),
+        std::ios_base::trunc | std::ios_base::binary
+      );
+
+      transfer->digest = (transfer->job.hasher ? transfer->job.hasher : config_.hasher)->begin();
+      transfer->download.digest = transfer->digest.get();
+
+      transfer->handle = acquire_handle(pool);
+
+      if (!transfer->handle) {
+        error() << "unable to resolve URL " << transfer->download.url << ", aborting remote download request";
+        transfer->file.close();
+        failed.push_back(transfer);
+        continue;
+      }
+
+      info() << "Downloading " << transfer->download.url;
+
+      curl_easy_setopt(transfer->handle, CURLOPT_ERRORBUFFER, transfer->curlerr);
+      curl_easy_setopt(transfer->handle, CURLOPT_URL, transfer->download.url.c_str());
+      curl_easy_setopt(transfer->handle, CURLOPT_WRITEFUNCTION, &on_curl_data);
+      curl_easy_setopt(transfer->handle, CURLOPT_WRITEDATA, &transfer->download);
+      curl_easy_setopt(transfer->handle, CURLOPT_PRIVATE, transfer);
+
+      curl_multi_add_handle(pool->multi, transfer->handle);
+
+      pool->active.push_back(transfer);
+    }
+  }
+
+  size_t
+  downloader::perform(int timeout_ms) const
+  {
+    connection_pool *pool = connections_;
+    std::vector<async_download_t*> done;
+
+    {
+      std::lock_guard<std::mutex> lock(pool->multi_mutex);
+
+      if (!pool->multi && (pool->multi = curl_multi_init()) == nullptr) {
+        error() << "unable to create a CURL multi handle, aborting asynchronous downloads";
+
+        done.insert(done.end(), pool->queued.begin(), pool->queued.end());
+        pool->queued.clear();
+      }
+      else {
+        int nr_running = 0;
+        int nr_messages = 0;
+        CURLMsg *message;
+
+        start_async_transfers(done);
+
+        curl_multi_perform(pool->multi, &nr_running);
+
+        if (nr_running > 0 && timeout_ms > 0) {
+          curl_multi_wait(pool->multi, nullptr, 0, timeout_ms, nullptr);
+          curl_multi_perform(pool->multi, &nr_running);
+        }
+
+        while ((message = curl_multi_info_read(pool->multi, &nr_messages)) != nullptr) {
+          if (message->msg != CURLMSG_DONE) {
+            continue;
+          }
+
+          async_download_t *transfer;
+          const CURLcode curlrc = message->data.result;
+
+          curl_easy_getinfo(message->easy_handle, CURLINFO_PRIVATE, &transfer);
+
+          bool successful = verify_response(transfer->handle, curlrc, transfer->curlerr);
+
+          curl_multi_remove_handle(pool->multi, transfer->handle);
+          release_handle(pool, transfer->handle);
+
+          transfer->handle = nullptr;
+          transfer->file.close();
+
+          if (transfer->file.fail()) {
+            error() << "Unable to write download to " << transfer->job.path;
+            successful = false;
+          }
+
+          pool->active.erase(std::find(pool->active.begin(), pool->active.end(), transfer));
+
+          if (successful && verify_integrity(transfer->job.path, transfer->job.checksum, transfer->digest.get())) {
+            transfer->succeeded = true;
+            done.push_back(transfer);
+          }
+          else if (transfer->attempt < retry_count_) {
+            notice() << "Retry #" << ++transfer->attempt << " of " << transfer->download.url;
+            pool->queued.push_front(transfer);
+          }
+          else {
+            done.push_back(transfer);
+          }
+        }
+
+        // fill in the slots of the transfers that are now done
+        start_async_transfers(done);
+      }
+    }
+
+    // callbacks are invoked without holding the lock so that they may queue
+    // more downloads
+    for (auto transfer : done) {
+      transfer->callback(transfer->job, transfer->succeeded);
+      delete transfer;
+    }
+
+    std::lock_guard<std::mutex> lock(pool->multi_mutex);
+
+    return pool->queued.size() + pool->active.size();
+  }
+
+  void
+  downloader::wait() const
+  {
+    while (perform(100) > 0) {
+    }
+  }
+
   url_t
   downloader::get_full_url(string_t const& url) const {
     if (url.find("http://") == std::string::npos) {
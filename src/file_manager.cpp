@@ -19,10 +19,32 @@
  */
 
 #include "karazeh/file_manager.hpp"
+#include <limits>
+
+#ifndef _WIN32
+  #include <cerrno>
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
 
 namespace kzh {
   namespace fs = boost::filesystem;
 
+  /** size of the blocks streams are loaded in */
+  static const size_t LOAD_BLOCK_SIZE = 64 * 1024;
+
+#ifndef _WIN32
+  /**
+   * Checks whether the effective user has the given access (see access(2))
+   * to a path, without opening or creating anything.
+   */
+  static bool has_access(string_t const& path, int mode) {
+    return faccessat(AT_FDCWD, path.c_str(), mode, AT_EACCESS) == 0;
+  }
+#endif
+
   file_manager::file_manager() : logger("file_manager")
   {
   }
@@ -34,19 +56,47 @@ namespace kzh {
   {
     if (!fs.is_open() || !fs.good()) return false;
 
-    while (fs.good()) {
-      out_buf.push_back(fs.get());
+    // size up what's left of the stream so that the buffer grows only once
+    const std::streampos start = fs.tellg();
+
+    if (start != std::streampos(-1) && fs.seekg(0, std::ios_base::end)) {
+      const std::streampos end = fs.tellg();
+
+      fs.seekg(start);
+
+      if (end > start) {
+        out_buf.reserve(out_buf.size() + static_cast<size_t>(end - start));
+      }
     }
 
-    out_buf.erase(out_buf.size()-1,1);
+    fs.clear();
 
-    return true;
+    char buffer[LOAD_BLOCK_SIZE];
+
+    while (fs.read(buffer, LOAD_BLOCK_SIZE) || fs.gcount() > 0) {
+      out_buf.append(buffer, static_cast<size_t>(fs.gcount()));
+    }
+
+    return !fs.bad();
   }
 
   bool file_manager::load_file(string_t const& path, string_t& out_buf) const
   {
+    return load_file(path_t(path), out_buf);
+  }
+
+  bool file_manager::load_file(path_t const& path, string_t& out_buf) const
+  {
+    std::unique_ptr<mapped_file> file(map_file(path));
+
+    if (file) {
+      out_buf.append(file->data() ? file->data() : "", file->size());
+
+      return true;
+    }
+
     bool rc;
-    std::ifstream fs(path.c_str());
+    std::ifstream fs(path.string().c_str(), std::ios_base::in | std::ios_base::binary);
 
     try {
       rc = load_file(fs, out_buf);
@@ -61,37 +111,45 @@ namespace kzh {
     return rc;
   }
 
-  bool file_manager::load_file(path_t const& path, string_t& out_buf) const
-  {
-    return load_file(path.string(), out_buf);
-  }
-
   bool file_manager::is_readable(string_t const& resource) const
   {
-    path_t path(resource);
+    #ifndef _WIN32
+      struct stat info;
 
-    try {
-      if (fs::exists(path)) {
-        if (fs::is_directory(path)) {
-          for (fs::directory_iterator it(path); it != fs::directory_iterator(); ++it) {
-            break;
-          }
+      if (stat(resource.c_str(), &info) != 0) {
+        return false;
+      }
 
-          return true;
-        }
-        else {
-          std::ifstream fs(resource.c_str());
-          bool readable = fs.is_open() && fs.good();
-          fs.close();
-          return fs::is_regular_file(path) && readable;
+      return (
+        (S_ISDIR(info.st_mode) || S_ISREG(info.st_mode)) &&
+        has_access(resource, R_OK)
+      );
+    #else
+      path_t path(resource);
+
+      try {
+        if (fs::exists(path)) {
+          if (fs::is_directory(path)) {
+            for (fs::directory_iterator it(path); it != fs::directory_iterator(); ++it) {
+              break;
+            }
+
+            return true;
+          }
+          else {
+            std::ifstream fs(resource.c_str());
+            bool readable = fs.is_open() && fs.good();
+            fs.close();
+            return fs::is_regular_file(path) && readable;
+          }
         }
       }
-    }
-    catch (fs::filesystem_error &e) {
-      return false;
-    }
+      catch (fs::filesystem_error &e) {
+        return false;
+      }
 
-    return false;
+      return false;
+    #endif
   }
 
   bool file_manager::is_readable(path_t const& resource) const
@@ -101,43 +159,69 @@ namespace kzh {
 
   bool file_manager::is_writable(string_t const& resource) const
   {
-    try {
-      path_t path(resource);
+    #ifndef _WIN32
+      struct stat info;
 
-      if (fs::exists(path)) {
-
-        if (is_directory(path)) {
-          return is_writable(path / "__karazeh_internal_directory_check__");
+      if (stat(resource.c_str(), &info) == 0) {
+        // a file can be created inside of it
+        if (S_ISDIR(info.st_mode)) {
+          return has_access(resource, W_OK | X_OK);
         }
 
-        // it already exists, make sure we don't overwrite it
-        std::ofstream fs(resource.c_str(), std::ios_base::app);
-        bool writable = fs.is_open() && fs.good() && !fs.fail();
-        fs.close();
-
-        return fs::is_regular_file(path) && writable;
-      } else {
+        return S_ISREG(info.st_mode) && has_access(resource, W_OK);
+      }
+      else if (errno == ENOENT) {
+        // it can be created if its parent directory is writable
+        const path_t parent(path_t(resource).parent_path());
+        const string_t parent_path(parent.empty() ? "." : parent.string());
+
+        return (
+          stat(parent_path.c_str(), &info) == 0 &&
+          S_ISDIR(info.st_mode) &&
+          has_access(parent_path, W_OK | X_OK)
+        );
+      }
 
-        // try creating a file and write to it
-        std::ofstream fs(resource.c_str(), std::ios_base::app);
-        bool writable = fs.is_open() && fs.good() && !fs.fail();
-        fs << "This was generated automatically by Karazeh and should have been deleted.";
-        fs.close();
+      return false;
+    #else
+      try {
+        path_t path(resource);
 
         if (fs::exists(path)) {
-          // delete the file
-          fs::remove(path);
-        }
 
-        return writable;
+          if (is_directory(path)) {
+            return is_writable(path / "__karazeh_internal_directory_check__");
+          }
+
+          // it already exists, make sure we don't overwrite it
+          std::ofstream fs(resource.c_str(), std::ios_base::app);
+          bool writable = fs.is_open() && fs.good() && !fs.fail();
+          fs.close();
+
+          return fs::is_regular_file(path) && writable;
+        } else {
+
+          // try creating a file and write to it
+          std::ofstream fs(resource.c_str(), std::ios_base::app);
+          bool writable = fs.is_open() && fs.good() && !fs.fail();
+          fs << "This was generated automatically by Karazeh and should have been deleted.";
+          fs.close();
+
+          if (fs::exists(path)) {
+            // delete the file
+            fs::remove(path);
+          }
+
+          return writable;
+        }
+      }
+      catch (fs::filesystem_error &e) {
+        // something bad happened, it is most likely unwritable
+        return false;
       }
-    }
-    catch (fs::filesystem_error &e) {
-      // something bad happened, it is most likely unwritable
-      return false;
-    }
 
-    return false;
+      return false;
+    #endif
   }
 
   bool file_manager::is_empty(path_t const& path) const
@@ -150,6 +234,24 @@ namespace kzh {
     return is_writable(path_t(resource).make_preferred().string());
   }
 
+  path_t file_manager::normalize(path_t const& path) {
+    path_t normal;
+
+    for (path_t::const_iterator it = path.begin(); it != path.end(); ++it) {
+      if (*it == ".") {
+        continue;
+      }
+      else if (*it == ".." && normal.has_relative_path() && normal.filename() != "..") {
+        normal.remove_filename();
+      }
+      else {
+        normal /= *it;
+      }
+    }
+
+    return normal;
+  }
+
   bool file_manager::is_directory(path_t const& path) const
   {
     return is_readable(path) && fs::is_directory(path);
@@ -277,4 +379,103 @@ namespace kzh {
       return false;
     }
   }
-}
\ No newline at end of file
+
+  std::unique_ptr<mapped_file> file_manager::map_file(path_t const& path) const {
+    std::unique_ptr<mapped_file> file(mapped_file::open(path));
+
+    if (!file) {
+      debug() << "Unable to map file " << path;
+    }
+
+    return file;
+  }
+
+  mapped_file::mapped_file()
+  : data_(nullptr),
+    size_(0),
+    mapped_(false)
+  {
+  }
+
+  mapped_file::~mapped_file() {
+    #ifndef _WIN32
+      if (mapped_) {
+        munmap(const_cast<char*>(data_), size_);
+      }
+    #endif
+  }
+
+  std::unique_ptr<mapped_file> mapped_file::open(path_t const& path) {
+    std::unique_ptr<mapped_file> file(new mapped_file());
+
+    #ifndef _WIN32
+      const int fd = ::open(path.string().c_str(), O_RDONLY);
+      struct stat info;
+
+      if (fd == -1) {
+        return nullptr;
+      }
+
+      if (
+        fstat(fd, &info) != 0 ||
+        !S_ISREG(info.st_mode) ||
+        static_cast<uint64_t>(info.st_size) > static_cast<uint64_t>(std::numeric_limits<size_t>::max())
+      ) {
+        close(fd);
+        return nullptr;
+      }
+
+      file->size_ = static_cast<size_t>(info.st_size);
+
+      // there's nothing to map for an empty file
+      if (file->size_ > 0) {
+        void *addr = mmap(nullptr, file->size_, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (addr == MAP_FAILED) {
+          close(fd);
+          return nullptr;
+        }
+
+        posix_madvise(addr, file->size_, POSIX_MADV_SEQUENTIAL);
+
+        file->data_ = static_cast<char const*>(addr);
+        file->mapped_ = true;
+      }
+
+      close(fd);
+    #else
+      std::ifstream fh(path.string().c_str(), std::ios_base::in | std::ios_base::binary | std::ios_base::ate);
+
+      if (!fh.is_open()) {
+        return nullptr;
+      }
+
+      const uint64_t size = static_cast<uint64_t>(fh.tellg());
+
+      if (size > static_cast<uint64_t>(std::numeric_limits<size_t>::max())) {
+        return nullptr;
+      }
+
+      file->buffer_.resize(static_cast<size_t>(size));
+      file->size_ = file->buffer_.size();
+
+      if (file->size_ > 0) {
+        if (!fh.seekg(0) || !fh.read(&file->buffer_[0], file->size_)) {
+          return nullptr;
+        }
+
+        file->data_ = &file->buffer_[0];
+      }
+    #endif
+
+    return file;
+  }
+
+  char const* mapped_file::data() const {
+    return data_;
+  }
+
+  size_t mapped_file::size() const {
+    return size_;
+  }
+}
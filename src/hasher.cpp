@@ -0,0 +1,107 @@
+/**
+ * karazeh -- the library for patching software
+ *
+ * Copyright (C) 2011-2016 by Ahmad Amireh <ahmad@amireh.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "karazeh/hasher.hpp"
+#include "karazeh/file_manager.hpp"
+#include "karazeh/hashers/md5_hasher.hpp"
+#include "karazeh/hashers/tree_hasher.hpp"
+#include "karazeh/hashers/xxh3_hasher.hpp"
+#include "karazeh/logger.hpp"
+#include <algorithm>
+#include <thread>
+
+namespace kzh {
+  /** size of the chunks files are fed to the digest in */
+  static const size_t READ_BLOCK_SIZE = 64 * 1024;
+
+  /** size of the chunks mapped files are fed to the digest in */
+  static const size_t MAPPED_BLOCK_SIZE = 1024 * 1024;
+
+  hasher::digest_rc hasher::hex_digest(string_t const& data) const {
+    std::unique_ptr<context> digest(begin());
+
+    digest->update(data.c_str(), data.size());
+
+    return digest->finalize();
+  }
+
+  hasher::digest_rc hasher::hex_digest(std::ifstream& fh) const {
+    if (!fh.is_open() || !fh.good()) {
+      logger l(name_);
+      l.error() << "filestream isn't valid! can not calculate hex digest";
+      return digest_rc();
+    }
+
+    std::unique_ptr<context> digest(begin());
+    char buffer[READ_BLOCK_SIZE];
+
+    while (fh.read(buffer, READ_BLOCK_SIZE) || fh.gcount() > 0) {
+      digest->update(buffer, static_cast<size_t>(fh.gcount()));
+    }
+
+    if (fh.bad()) {
+      logger l(name_);
+      l.error() << "unable to read filestream, can not calculate hex digest";
+      return digest_rc();
+    }
+
+    return digest->finalize();
+  }
+
+  hasher::digest_rc hasher::hex_digest(path_t const& fp) const {
+    std::unique_ptr<mapped_file> file(mapped_file::open(fp));
+
+    if (file) {
+      std::unique_ptr<context> digest(begin());
+
+      for (size_t offset = 0; offset < file->size(); offset += MAPPED_BLOCK_SIZE) {
+        digest->update(file->data() + offset, std::min(MAPPED_BLOCK_SIZE, file->size() - offset));
+      }
+
+      return digest->finalize();
+    }
+
+    // fall back to reading the file, which also reports the error
+    std::ifstream fh(fp.c_str(), std::ifstream::in | std::ifstream::binary);
+    digest_rc rc(hex_digest(fh));
+    fh.close();
+
+    return rc;
+  }
+
+  hasher const* hasher::find(string_t const& name) {
+    static const md5_hasher md5;
+    static const xxh3_hasher xxh3;
+
+    static const int concurrency = static_cast<int>(std::thread::hardware_concurrency());
+    static const tree_hasher md5_tree(md5, tree_hasher::DEFAULT_CHUNK_SIZE, concurrency);
+    static const tree_hasher xxh3_tree(xxh3, tree_hasher::DEFAULT_CHUNK_SIZE, concurrency);
+
+    static const hasher* hashers[] = { &md5, &xxh3, &md5_tree, &xxh3_tree };
+
+    for (auto candidate : hashers) {
+      if (candidate->name() == name) {
+        return candidate;
+      }
+    }
+
+    return nullptr;
+  }
+}
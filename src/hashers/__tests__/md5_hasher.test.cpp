@@ -16,4 +16,32 @@ TEST_CASE("MD5Hasher") {
     REQUIRE(drc.valid);
     REQUIRE(drc.digest == "f1eb970aeb2e380593480ed76070acbe");
   }
-}
\ No newline at end of file
+
+  SECTION("it should calculate a digest incrementally") {
+    const string_t data("CALCULATE MY HEX DIGEST\n");
+    auto context = subject.begin();
+
+    REQUIRE(context);
+
+    context->update(data.c_str(), 10);
+    context->update(data.c_str() + 10, data.size() - 10);
+
+    hasher::digest_rc drc = context->finalize();
+
+    REQUIRE(drc.valid);
+    REQUIRE(drc.digest == "f1eb970aeb2e380593480ed76070acbe");
+  }
+
+  SECTION("it should calculate a digest of raw data") {
+    hasher::digest_rc drc = subject.hex_digest(string_t("CALCULATE MY HEX DIGEST\n"));
+
+    REQUIRE(drc.valid);
+    REQUIRE(drc.digest == "f1eb970aeb2e380593480ed76070acbe");
+  }
+
+  SECTION("it should not calculate a digest of a missing file") {
+    hasher::digest_rc drc = subject.hex_digest(test_config.fixture_path / "does_not_exist.txt");
+
+    REQUIRE_FALSE(drc.valid);
+  }
+}
@@ -0,0 +1,63 @@
+#include "catch.hpp"
+#include "test_utils.hpp"
+#include "karazeh/karazeh.hpp"
+#include "karazeh/hashers/md5_hasher.hpp"
+#include "karazeh/hashers/tree_hasher.hpp"
+
+using namespace kzh;
+
+TEST_CASE("TreeHasher") {
+  md5_hasher leaf;
+  tree_hasher subject(leaf, 4, 4);
+
+  SECTION("it should be named after the leaf hasher") {
+    REQUIRE(subject.name() == "MD5-TREE");
+    REQUIRE(hasher::find("XXH3-TREE") != nullptr);
+  }
+
+  SECTION("it should digest the joined digests of the chunks") {
+    const string_t chunk_digests(
+      leaf.hex_digest(string_t("abcd")).digest +
+      leaf.hex_digest(string_t("efgh")).digest +
+      leaf.hex_digest(string_t("ij")).digest
+    );
+
+    hasher::digest_rc drc = subject.hex_digest(string_t("abcdefghij"));
+
+    REQUIRE(drc.valid);
+    REQUIRE(drc.digest == leaf.hex_digest(chunk_digests).digest);
+  }
+
+  SECTION("it should digest empty input as a single chunk") {
+    REQUIRE(
+      subject.hex_digest(string_t()).digest ==
+      leaf.hex_digest(leaf.hex_digest(string_t()).digest).digest
+    );
+  }
+
+  SECTION("it should digest files in parallel") {
+    const path_t file_path(test_config.temp_path / "tree_hasher.bin");
+    string_t data(1024 * 1024 + 17, '\0');
+
+    for (size_t i = 0; i < data.size(); ++i) {
+      data[i] = static_cast<char>(i % 251);
+    }
+
+    test_utils::create_file(file_path, data);
+
+    tree_hasher parallel(leaf, 64 * 1024, 4);
+    tree_hasher serial(leaf, 64 * 1024, 1);
+
+    hasher::digest_rc drc = parallel.hex_digest(file_path);
+
+    REQUIRE(drc.valid);
+    REQUIRE(drc.digest == serial.hex_digest(file_path).digest);
+    REQUIRE(drc.digest == parallel.hex_digest(data).digest);
+
+    test_utils::remove_file(file_path);
+  }
+
+  SECTION("it should not digest a missing file") {
+    REQUIRE_FALSE(subject.hex_digest(test_config.fixture_path / "does_not_exist.txt").valid);
+  }
+}
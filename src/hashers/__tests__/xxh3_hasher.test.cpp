@@ -0,0 +1,50 @@
+#include "catch.hpp"
+#include "test_utils.hpp"
+#include "karazeh/karazeh.hpp"
+#include "karazeh/hashers/xxh3_hasher.hpp"
+
+using namespace kzh;
+
+TEST_CASE("XXH3Hasher") {
+  xxh3_hasher subject;
+
+  SECTION("it should calculate a digest") {
+    hasher::digest_rc drc = subject.hex_digest(
+      (test_config.fixture_path / "hash_me.txt").make_preferred()
+    );
+
+    REQUIRE(drc.valid);
+    REQUIRE(drc.digest == "984e6c68de3eeb4ba9eaaf6407014d2e");
+  }
+
+  SECTION("it should calculate a digest of empty input") {
+    REQUIRE(subject.hex_digest(string_t()).digest == "99aa06d3014798d86001c324468d497f");
+  }
+
+  SECTION("it should calculate a digest incrementally") {
+    string_t data(1000000, '\0');
+
+    for (size_t i = 0; i < data.size(); ++i) {
+      data[i] = static_cast<char>(i % 251);
+    }
+
+    auto context = subject.begin();
+
+    // uneven chunks so that the input does not line up with the stripes
+    for (size_t offset = 0; offset < data.size(); offset += 4099) {
+      context->update(data.c_str() + offset, std::min<size_t>(4099, data.size() - offset));
+    }
+
+    hasher::digest_rc drc = context->finalize();
+
+    REQUIRE(drc.valid);
+    REQUIRE(drc.digest == "00d4a9d9f77c7d2ddf99c4163891c544");
+    REQUIRE(subject.hex_digest(data).digest == drc.digest);
+  }
+
+  SECTION("it can be looked up by name") {
+    REQUIRE(hasher::find("XXH3") != nullptr);
+    REQUIRE(hasher::find("XXH3")->name() == "XXH3");
+    REQUIRE(hasher::find("CRC32") == nullptr);
+  }
+}
@@ -19,40 +19,35 @@
  */
 
 #include "karazeh/hashers/md5_hasher.hpp"
-#include "karazeh/logger.hpp"
 
 namespace kzh {
 
-  hasher::digest_rc md5_hasher::hex_digest(string_t const& data) const {
-    digest_rc rc;
+  class md5_context : public hasher::context {
+  public:
+    virtual void update(const char* data, size_t length) {
+      md5_.update(
+        reinterpret_cast<unsigned char*>(const_cast<char*>(data)),
+        static_cast<unsigned int>(length)
+      );
+    }
 
-    rc.digest = MD5(data).hex_digest();
-    rc.valid = true;
+    virtual hasher::digest_rc finalize() {
+      hasher::digest_rc rc;
 
-    return rc;
-  }
+      md5_.finalize();
 
-  hasher::digest_rc md5_hasher::hex_digest(std::ifstream& fh) const {
-    digest_rc rc;
+      rc.digest = md5_.hex_digest();
+      rc.valid = true;
 
-    if (!fh.is_open() || !fh.good()) {
-      logger l("md5_hasher");
-      l.error() << "filestream isn't valid! can not calculate hex digest";
       return rc;
     }
 
-    rc.digest = MD5(fh).hex_digest();
-    rc.valid = true;
-
-    return rc;
-  }
-
-  hasher::digest_rc md5_hasher::hex_digest(path_t const& fp) const {
-    std::ifstream fh(fp.c_str(), std::ifstream::in | std::ifstream::binary);
-    digest_rc rc(hex_digest(fh));
-    fh.close();
+  private:
+    MD5 md5_;
+  };
 
-    return rc;
+  std::unique_ptr<hasher::context> md5_hasher::begin() const {
+    return std::unique_ptr<hasher::context>(new md5_context());
   }
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,195 @@
+/**
+ * karazeh -- the library for patching software
+ *
+ * Copyright (C) 2011-2016 by Ahmad Amireh <ahmad@amireh.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "karazeh/hashers/tree_hasher.hpp"
+#include "karazeh/file_manager.hpp"
+#include "karazeh/logger.hpp"
+#include "karazeh/worker_pool.hpp"
+#include <algorithm>
+#include <vector>
+
+namespace kzh {
+  /** size of the blocks chunks are read in */
+  static const uint64_t READ_BLOCK_SIZE = 64 * 1024;
+
+  const uint64_t tree_hasher::DEFAULT_CHUNK_SIZE;
+
+  class tree_context : public hasher::context {
+  public:
+    tree_context(hasher const& leaf, uint64_t chunk_size)
+    : leaf_(leaf),
+      chunk_size_(chunk_size),
+      chunk_(leaf.begin()),
+      chunk_fill_(0),
+      valid_(true)
+    {}
+
+    virtual void update(const char* data, size_t length) {
+      while (length > 0) {
+        if (chunk_fill_ == chunk_size_) {
+          finish_chunk();
+        }
+
+        const size_t fill = static_cast<size_t>(
+          std::min<uint64_t>(length, chunk_size_ - chunk_fill_)
+        );
+
+        chunk_->update(data, fill);
+        chunk_fill_ += fill;
+        data += fill;
+        length -= fill;
+      }
+    }
+
+    virtual hasher::digest_rc finalize() {
+      // the last chunk is always digested, even if there was no input at all
+      finish_chunk();
+
+      hasher::digest_rc rc = leaf_.hex_digest(chunk_digests_);
+
+      rc.valid = rc.valid && valid_;
+
+      return rc;
+    }
+
+  private:
+    hasher const& leaf_;
+    const uint64_t chunk_size_;
+    std::unique_ptr<hasher::context> chunk_;
+    uint64_t chunk_fill_;
+    string_t chunk_digests_;
+    bool valid_;
+
+    void finish_chunk() {
+      hasher::digest_rc rc = chunk_->finalize();
+
+      valid_ = valid_ && rc.valid;
+      chunk_digests_ += rc.digest;
+      chunk_ = leaf_.begin();
+      chunk_fill_ = 0;
+    }
+  };
+
+  tree_hasher::tree_hasher(hasher const& leaf, uint64_t chunk_size, int concurrency)
+  : hasher(leaf.name() + "-TREE"),
+    leaf_(leaf),
+    chunk_size_(std::max<uint64_t>(chunk_size, 1)),
+    concurrency_(concurrency)
+  {}
+
+  std::unique_ptr<hasher::context> tree_hasher::begin() const {
+    return std::unique_ptr<hasher::context>(new tree_context(leaf_, chunk_size_));
+  }
+
+  hasher::digest_rc tree_hasher::hex_digest(path_t const& path) const {
+    boost::system::error_code ec;
+    const uint64_t size = boost::filesystem::file_size(path, ec);
+
+    if (ec) {
+      logger l(name_);
+      l.error() << "unable to stat " << path << ", can not calculate hex digest";
+      return digest_rc();
+    }
+
+    const size_t nr_chunks = static_cast<size_t>(
+      std::max<uint64_t>(1, (size + chunk_size_ - 1) / chunk_size_)
+    );
+
+    std::vector<string_t> chunk_digests(nr_chunks);
+    std::unique_ptr<mapped_file> file(mapped_file::open(path));
+
+    const worker_pool workers(static_cast<int>(
+      std::min<uint64_t>(std::max(concurrency_, 1), nr_chunks)
+    ));
+
+    const auto digest_mapped_chunk = [&](size_t i) -> bool {
+      const size_t offset = static_cast<size_t>(i * chunk_size_);
+      const size_t length = static_cast<size_t>(std::min<uint64_t>(chunk_size_, file->size() - offset));
+      std::unique_ptr<context> digest(leaf_.begin());
+
+      digest->update(file->data() + offset, length);
+
+      digest_rc rc = digest->finalize();
+
+      chunk_digests[i] = rc.digest;
+
+      return rc.valid;
+    };
+
+    // when the file can't be mapped, every chunk is read through its own
+    // stream so that the workers don't have to take turns seeking
+    const auto digest_chunk = [&](size_t i) -> bool {
+      const uint64_t offset = i * chunk_size_;
+      uint64_t remaining = std::min(chunk_size_, size - offset);
+
+      std::ifstream fh(path.string().c_str(), std::ifstream::in | std::ifstream::binary);
+      std::vector<char> buffer(static_cast<size_t>(std::min(remaining, READ_BLOCK_SIZE)));
+      std::unique_ptr<context> digest(leaf_.begin());
+
+      if (!fh.is_open() || !fh.seekg(offset)) {
+        return false;
+      }
+
+      while (remaining > 0) {
+        const size_t length = static_cast<size_t>(std::min<uint64_t>(remaining, buffer.size()));
+
+        if (!fh.read(&buffer[0], length)) {
+          return false;
+        }
+
+        digest->update(&buffer[0], length);
+        remaining -= length;
+      }
+
+      digest_rc rc = digest->finalize();
+
+      chunk_digests[i] = rc.digest;
+
+      return rc.valid;
+    };
+
+    // the size may have changed in the meantime
+    const bool read_all = file && file->size() == size ?
+      workers.run(nr_chunks, digest_mapped_chunk) :
+      workers.run(nr_chunks, digest_chunk);
+
+    if (!read_all) {
+      logger l(name_);
+      l.error() << "unable to read " << path << ", can not calculate hex digest";
+      return digest_rc();
+    }
+
+    string_t joined_digests;
+
+    for (auto const& digest : chunk_digests) {
+      joined_digests += digest;
+    }
+
+    return leaf_.hex_digest(joined_digests);
+  }
+
+  uint64_t tree_hasher::chunk_size() const {
+    return chunk_size_;
+  }
+
+  int tree_hasher::concurrency() const {
+    return concurrency_;
+  }
+}
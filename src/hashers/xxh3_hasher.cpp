@@ -0,0 +1,130 @@
+/**
+ * karazeh -- the library for patching software
+ *
+ * Copyright (C) 2011-2016 by Ahmad Amireh <ahmad@amireh.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#define XXH_INLINE_ALL
+#include "xxhash/xxhash.h"
+#include "karazeh/hashers/xxh3_hasher.hpp"
+
+namespace kzh {
+  typedef void (*xxh3_update_t)(XXH3_state_t*, const void*, size_t);
+  typedef XXH128_hash_t (*xxh3_digest_t)(const XXH3_state_t*);
+
+  /** the XXH3 routines built for one instruction set */
+  struct xxh3_kernel_t {
+    char const*     name;
+    xxh3_update_t   update;
+    xxh3_digest_t   digest;
+  };
+
+  static void xxh3_update_baseline(XXH3_state_t* state, const void* data, size_t length) {
+    XXH3_128bits_update(state, data, length);
+  }
+
+  static XXH128_hash_t xxh3_digest_baseline(const XXH3_state_t* state) {
+    return XXH3_128bits_digest(state);
+  }
+}
+
+#ifdef KARAZEH_XXH3_DISPATCH
+extern "C" {
+  void kzh_xxh3_update_avx2(XXH3_state_t*, const void*, size_t);
+  XXH128_hash_t kzh_xxh3_digest_avx2(const XXH3_state_t*);
+  void kzh_xxh3_update_avx512(XXH3_state_t*, const void*, size_t);
+  XXH128_hash_t kzh_xxh3_digest_avx512(const XXH3_state_t*);
+}
+#endif
+
+namespace kzh {
+  static xxh3_kernel_t select_kernel() {
+    #ifdef KARAZEH_XXH3_DISPATCH
+      __builtin_cpu_init();
+
+      if (__builtin_cpu_supports("avx512f")) {
+        return { "avx512", &kzh_xxh3_update_avx512, &kzh_xxh3_digest_avx512 };
+      }
+      else if (__builtin_cpu_supports("avx2")) {
+        return { "avx2", &kzh_xxh3_update_avx2, &kzh_xxh3_digest_avx2 };
+      }
+    #endif
+
+    #if XXH_VECTOR == XXH_SSE2
+      return { "sse2", &xxh3_update_baseline, &xxh3_digest_baseline };
+    #elif XXH_VECTOR == XXH_NEON
+      return { "neon", &xxh3_update_baseline, &xxh3_digest_baseline };
+    #else
+      return { "scalar", &xxh3_update_baseline, &xxh3_digest_baseline };
+    #endif
+  }
+
+  static xxh3_kernel_t const& get_kernel() {
+    static const xxh3_kernel_t kernel(select_kernel());
+
+    return kernel;
+  }
+
+  class xxh3_context : public hasher::context {
+  public:
+    // the state has to be allocated by xxHash as the SIMD kernels need it
+    // aligned to 64 bytes
+    xxh3_context() : kernel_(get_kernel()), state_(XXH3_createState()) {
+      XXH3_128bits_reset(state_);
+    }
+
+    virtual ~xxh3_context() {
+      XXH3_freeState(state_);
+    }
+
+    virtual void update(const char* data, size_t length) {
+      kernel_.update(state_, data, length);
+    }
+
+    virtual hasher::digest_rc finalize() {
+      static const char hex[] = "0123456789abcdef";
+
+      hasher::digest_rc rc;
+      XXH128_canonical_t canonical;
+
+      XXH128_canonicalFromHash(&canonical, kernel_.digest(state_));
+
+      rc.digest.reserve(sizeof(canonical.digest) * 2);
+
+      for (unsigned char byte : canonical.digest) {
+        rc.digest += hex[byte >> 4];
+        rc.digest += hex[byte & 0x0f];
+      }
+
+      rc.valid = true;
+
+      return rc;
+    }
+
+  private:
+    xxh3_kernel_t const& kernel_;
+    XXH3_state_t *state_;
+  };
+
+  std::unique_ptr<hasher::context> xxh3_hasher::begin() const {
+    return std::unique_ptr<hasher::context>(new xxh3_context());
+  }
+
+  char const* xxh3_hasher::kernel() {
+    return get_kernel().name;
+  }
+}
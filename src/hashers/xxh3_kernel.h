@@ -0,0 +1,39 @@
+/**
+ * karazeh -- the library for patching software
+ *
+ * Copyright (C) 2011-2016 by Ahmad Amireh <ahmad@amireh.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * Builds the XXH3 routines the hasher dispatches to for one instruction set.
+ * Including files define XXH_VECTOR and KZH_XXH3_KERNEL(), and are compiled
+ * with the matching target flags; see src/CMakeLists.txt.
+ *
+ * These are C sources so that none of the code built for a wider instruction
+ * set can be picked by the linker in place of the baseline one.
+ */
+
+#define XXH_INLINE_ALL
+#include "xxhash/xxhash.h"
+
+void KZH_XXH3_KERNEL(update)(XXH3_state_t* state, const void* data, size_t length) {
+  XXH3_128bits_update(state, data, length);
+}
+
+XXH128_hash_t KZH_XXH3_KERNEL(digest)(const XXH3_state_t* state) {
+  return XXH3_128bits_digest(state);
+}
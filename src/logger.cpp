@@ -20,17 +20,19 @@
 
 #include "karazeh/logger.hpp"
 #include <iomanip>
+#include <mutex>
 
 namespace kzh {
 
   static char levels[] = { 'D','I','N','W','E','A','C' };
   static char threshold = 'D';
 
-  ostringstream logger::sink;
+  static std::mutex out_mutex;
+
   ostream*      logger::out = &std::cout;
   bool          logger::with_timestamps = true;
   string_t      logger::app_name = "";
-  int           logger::indent_level = 0;
+  std::atomic<int> logger::indent_level(0);
   bool          logger::silenced = false;
 
   void logger::mute() {
@@ -73,9 +75,9 @@ namespace kzh {
   {
   }
 
-  ostream& logger::log(char lvl) const {
+  logstream logger::log(char lvl) const {
     if (silenced)
-      return sink;
+      return logstream(nullptr);
 
     bool enabled = false;
     for (int i = 0; i < 7; ++i)
@@ -83,7 +85,9 @@ namespace kzh {
       else if (levels[i] == lvl) break;
 
     if (!enabled)
-      return sink;
+      return logstream(nullptr);
+
+    logstream stream(out);
 
     if (with_timestamps) {
       struct tm *pTime;
@@ -98,20 +102,20 @@ namespace kzh {
         << ":" << std::setw(2) << std::setfill('0') << pTime->tm_min
         << ":" << std::setw(2) << std::setfill('0') << pTime->tm_sec
         << " ";
-      (*out) << timestamp.str();
+      stream << timestamp.str();
     }
 
     if (!app_name.empty()) {
-      (*out) << app_name << " ";
+      stream << app_name << " ";
     }
 
     for (int i = 0; i < indent_level; ++i)
-      (*out) << "  ";
+      stream << "  ";
 
-    (*out) << "[" << lvl << "]" << uuid_prefix_ << " "
+    stream << "[" << lvl << "]" << uuid_prefix_ << " "
       << (context_.empty() ? "" : context_ + ": ");
 
-    return *out;
+    return stream;
   }
 
   void logger::set_uuid_prefix(string_t const& uuid) {
@@ -121,20 +125,31 @@ namespace kzh {
     return uuid_prefix_;
   }
 
-  logstream logger::debug()  const { return logstream(log('D')); }
-  logstream logger::info()   const { return logstream(log('I')); }
-  logstream logger::notice() const { return logstream(log('N')); }
-  logstream logger::warn()   const { return logstream(log('W')); }
-  logstream logger::error()  const { return logstream(log('E')); }
-  logstream logger::alert()  const { return logstream(log('A')); }
-  logstream logger::crit()   const { return logstream(log('C')); }
-  logstream logger::plain()  const { return logstream(*out); }
-
-  logstream::logstream(std::ostream& in_s)
-  : s(in_s) {}
+  logstream logger::debug()  const { return log('D'); }
+  logstream logger::info()   const { return log('I'); }
+  logstream logger::notice() const { return log('N'); }
+  logstream logger::warn()   const { return log('W'); }
+  logstream logger::error()  const { return log('E'); }
+  logstream logger::alert()  const { return log('A'); }
+  logstream logger::crit()   const { return log('C'); }
+  logstream logger::plain()  const { return logstream(out); }
+
+  logstream::logstream(std::ostream* in_out)
+  : out(in_out) {}
+
+  logstream::logstream(logstream&& other)
+  : out(other.out),
+    buf(std::move(other.buf))
+  {
+    other.out = nullptr;
+  }
 
   logstream::~logstream() {
-    s << std::endl;
+    if (out) {
+      std::lock_guard<std::mutex> lock(out_mutex);
+
+      (*out) << buf.str() << std::endl;
+    }
   }
 
   void logger::rename_context(string_t const& new_ctx) {
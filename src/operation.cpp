@@ -34,4 +34,8 @@ namespace kzh {
   {}
 
   operation::~operation() {}
+
+  hasher const* operation::get_hasher() const {
+    return rm_.hasher ? rm_.hasher : config_.hasher;
+  }
 }
@@ -54,7 +54,7 @@ TEST_CASE("update_operation") {
 
   auto serve_delta_file = [&]() {
     When(FI_DOWNLOADER_FETCH(downloader_spy)).AlwaysDo(
-      [&](string_t const &url, path_t const & out, string_t const& checksum, int* const) {
+      [&](string_t const &url, path_t const & out, string_t const& checksum, int* const, kzh::hasher const*) {
         REQUIRE(url == delta_url);
 
         string_t delta_contents;
@@ -113,7 +113,8 @@ TEST_CASE("update_operation") {
         string_t const &url,
         path_t const &out,
         string_t const& checksum,
-        int* const
+        int* const,
+        kzh::hasher const*
        ) {
         REQUIRE(url == delta_url);
         REQUIRE(checksum == delta_checksum);
@@ -123,21 +124,12 @@ TEST_CASE("update_operation") {
       REQUIRE_THROWS_AS(subject.stage(), kzh::invalid_resource);
     }
 
-    SECTION("It generates a signature of the basis file") {
+    SECTION("It only downloads the delta file") {
       serve_delta_file();
 
       REQUIRE(subject.stage() == kzh::STAGE_OK);
-
-      // assert the contents, this wouldn't have been necessary were we able to
-      // spy on the operation's delta_encoder instance, but oh well:
-      REQUIRE(
-        hasher.hex_digest(
-          config.cache_path / manifest.id / "0" / "signature"
-        ).digest == hasher.hex_digest(
-          // the one we've generated in the fixture stage
-          config.root_path / "old_file.txt.signature"
-        ).digest
-      );
+      REQUIRE(file_manager.exists(config.cache_path / manifest.id / "0" / "delta"));
+      REQUIRE_FALSE(file_manager.exists(config.cache_path / manifest.id / "0" / "signature"));
     }
   } // Staging
 
@@ -154,9 +146,38 @@ TEST_CASE("update_operation") {
       );
     }
 
+    WHEN("Streaming patches...") {
+      config.stream_patches = true;
+      test_utils::remove_file(cache_path / "delta");
+
+      When(FI_DOWNLOADER_FETCH_STREAM(downloader_spy)).AlwaysDo(
+        [&](string_t const &url, std::ostream& out, string_t const& checksum, kzh::hasher const*) {
+          REQUIRE(url == delta_url);
+          REQUIRE(checksum == delta_checksum);
+
+          string_t delta_contents;
+          file_manager.load_file(config.root_path / "old_file.txt.delta", delta_contents);
+          out.write(delta_contents.data(), delta_contents.size());
+
+          return true;
+        }
+      );
+
+      THEN("It patches the file while downloading the delta") {
+        REQUIRE(subject.stage() == kzh::STAGE_OK);
+        REQUIRE_FALSE(file_manager.exists(cache_path / "delta"));
+        REQUIRE(subject.deploy() == kzh::STAGE_OK);
+
+        REQUIRE(
+          hasher.hex_digest(file_path).digest ==
+          hasher.hex_digest(updated_file_path).digest
+        );
+      }
+    }
+
     WHEN("Patching fails...") {
       When(FI_DOWNLOADER_FETCH(downloader_spy)).AlwaysDo(
-        [&](string_t const &url, path_t const & out, string_t const& checksum, int* const) {
+        [&](string_t const &url, path_t const & out, string_t const& checksum, int* const, kzh::hasher const*) {
           REQUIRE(url == delta_url);
           test_utils::create_file(out, "junk delta junk");
           return true;
@@ -20,6 +20,8 @@
 
 #include "karazeh/operations/create.hpp"
 #include "karazeh/release_manifest.hpp"
+#include "karazeh/digest_cache.hpp"
+#include "karazeh/delta_codec.hpp"
 
 namespace kzh {
   namespace fs = boost::filesystem;
@@ -90,10 +92,39 @@ namespace kzh {
       return STAGE_UNAUTHORIZED;
     }
 
-    if (!config_.downloader->fetch(src_uri, cache_path_, src_checksum)) {
+    if (!config_.downloader->fetch(src_uri, cache_path_, src_checksum, nullptr, get_hasher())) {
       throw invalid_resource(src_uri);
     }
 
+    return apply_chained_deltas();
+  }
+
+  STAGE_RC create_operation::apply_chained_deltas() {
+    auto file_manager = config_.file_manager;
+    const path_t delta_path(cache_dir_ / "delta");
+    const path_t previous_path(path_t(cache_path_.string() + ".basis").make_preferred());
+
+    for (auto const& chained_delta : chained_deltas) {
+      if (!config_.downloader->fetch(chained_delta.url, delta_path, chained_delta.checksum, nullptr, get_hasher())) {
+        throw invalid_resource(chained_delta.url);
+      }
+
+      file_manager->move(cache_path_, previous_path);
+
+      const rs_result rc = chained_delta.codec->patch(previous_path, delta_path, cache_path_);
+
+      file_manager->remove_file(previous_path);
+      file_manager->remove_file(delta_path);
+
+      if (rc != RS_DONE) {
+        error()
+          << "Patching " << cache_path_ << " using " << chained_delta.url
+          << " has failed. " << chained_delta.codec->name() << " rc: " << rc;
+
+        return STAGE_ENCODING_ERROR;
+      }
+    }
+
     return STAGE_OK;
   }
 
@@ -124,10 +155,10 @@ namespace kzh {
     file_manager->move(cache_path_, destination);
 
     // validate integrity
-    hasher::digest_rc rc = config_.hasher->hex_digest(destination);
+    hasher::digest_rc rc = get_hasher()->hex_digest(destination);
 
-    if (rc != src_checksum) {
-      error() << "Created file integrity mismatch: " << rc.digest << " vs " << src_checksum;
+    if (rc != get_checksum()) {
+      error() << "Created file integrity mismatch: " << rc.digest << " vs " << get_checksum();
       return STAGE_FILE_INTEGRITY_MISMATCH;
     }
 
@@ -147,18 +178,22 @@ namespace kzh {
 
   void create_operation::commit() {
     auto file_manager = config_.file_manager;
-    auto hasher = config_.hasher;
+    auto hasher = get_hasher();
 
     // in case of roll back, the source file will still be staged in the cache
     if (
       file_manager->exists(cache_path_) &&
       // just to be safe, double-check it's our own file!
-      hasher->hex_digest(cache_path_) == src_checksum
+      hasher->hex_digest(cache_path_) == get_checksum()
     ) {
       file_manager->remove_file(cache_path_);
     }
   }
 
+  void create_operation::refresh_digests(digest_cache& cache) const {
+    cache.refresh(*get_hasher(), get_destination(), get_checksum());
+  }
+
   string_t create_operation::tostring() {
     std::ostringstream s;
 
@@ -176,11 +211,15 @@ namespace kzh {
 
     return (
       config_.file_manager->exists(destination) &&
-      config_.hasher->hex_digest(destination) == src_checksum
+      get_hasher()->hex_digest(destination) == get_checksum()
     );
   }
 
   path_t create_operation::get_destination() const {
     return config_.root_path / dst_path;
   }
+
+  string_t const& create_operation::get_checksum() const {
+    return chained_deltas.empty() ? src_checksum : patched_checksum;
+  }
 }
\ No newline at end of file
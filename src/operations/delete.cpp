@@ -20,6 +20,7 @@
 
 #include "karazeh/operations/delete.hpp"
 #include "karazeh/release_manifest.hpp"
+#include "karazeh/digest_cache.hpp"
 
 namespace kzh {
   namespace fs = boost::filesystem;
@@ -121,6 +122,10 @@ namespace kzh {
     config_.file_manager->remove_file(cache_path_);
   }
 
+  void delete_operation::refresh_digests(digest_cache& cache) const {
+    cache.remove(config_.root_path / dst_path);
+  }
+
   string_t delete_operation::tostring() {
     std::ostringstream s;
     s << "delete from[" << this->dst_path << ']';
@@ -20,6 +20,8 @@
 
 #include "karazeh/operations/update.hpp"
 #include "karazeh/release_manifest.hpp"
+#include "karazeh/digest_cache.hpp"
+#include <fstream>
 
 namespace kzh {
   update_operation::update_operation(
@@ -31,12 +33,13 @@ namespace kzh {
   )
   : operation(id, config, release),
     logger("op_update"),
+    codec(delta_codec::find("rsync")),
     patched_(false),
+    streamed_(false),
 
     basis_path_(in_basis_path),
     delta_url_(in_delta_url),
 
-    signature_path_(cache_dir_ / "signature"),
     delta_path_(cache_dir_ / "delta"),
     patched_path_(cache_dir_ / "patched")
   {
@@ -49,6 +52,11 @@ namespace kzh {
     std::ostringstream s;
     s << "update basis[" << basis_path_ << ']'
       << " using[" << delta_path_ << ']';
+
+    if (!chained_deltas.empty()) {
+      s << " and " << chained_deltas.size() << " chained deltas";
+    }
+
     return s.str();
   }
 
@@ -63,7 +71,7 @@ namespace kzh {
     }
 
     // basis checksum check
-    hasher::digest_rc digest = config_.hasher->hex_digest(basis_path_);
+    hasher::digest_rc digest = get_hasher()->hex_digest(basis_path_);
 
     if (digest != basis_checksum) {
       error()
@@ -84,47 +92,156 @@ namespace kzh {
 
     // TODO: free space checks, need at least 2x basis file size + delta size
 
+    if (config_.stream_patches) {
+      STAGE_RC rc = stream_patch(basis_path_, delta_url_, delta_checksum, codec);
+
+      // every chained delta is streamed on the output of the one before it
+      const path_t previous_path(path_t(patched_path_.string() + ".basis").make_preferred());
+
+      for (size_t i = 0; i < chained_deltas.size() && rc == STAGE_OK; ++i) {
+        chained_delta_t const& chained_delta = chained_deltas[i];
+
+        file_manager->move(patched_path_, previous_path);
+
+        rc = stream_patch(previous_path, chained_delta.url, chained_delta.checksum, chained_delta.codec);
+
+        file_manager->remove_file(previous_path);
+      }
+
+      streamed_ = rc == STAGE_OK;
+
+      return rc;
+    }
+
     // get the delta patch
-    if (!config_.downloader->fetch(delta_url_, delta_path_, delta_checksum)) {
+    if (!config_.downloader->fetch(delta_url_, delta_path_, delta_checksum, nullptr, get_hasher())) {
       throw invalid_resource(delta_url_);
     }
 
-    // create the signature
-    debug() << "generating signature for " << basis_path_ << " out to " << signature_path_;
+    for (size_t i = 0; i < chained_deltas.size(); ++i) {
+      chained_delta_t const& chained_delta = chained_deltas[i];
 
-    rs_result rc = encoder_.signature(basis_path_, signature_path_);
+      if (!config_.downloader->fetch(chained_delta.url, get_chained_delta_path(i), chained_delta.checksum, nullptr, get_hasher())) {
+        throw invalid_resource(chained_delta.url);
+      }
+    }
 
-    if (rc != RS_DONE) {
-      error() << "Generating of signature for file " << basis_path_ << " has failed. librsync rc: " << rc;
-      return STAGE_ENCODING_ERROR;
+    return STAGE_OK;
+  }
+
+  STAGE_RC update_operation::stream_patch(
+    path_t const& basis_path,
+    string_t const& delta_url,
+    string_t const& checksum,
+    delta_codec const* delta_codec
+  ) {
+    auto file_manager = config_.file_manager;
+    auto downloader   = config_.downloader;
+
+    std::unique_ptr<mapped_file> basis(file_manager->map_file(basis_path));
+
+    if (!basis) {
+      error() << "Unable to map basis file " << basis_path;
+      return STAGE_FILE_MISSING;
+    }
+
+    debug() << "patching file " << basis_path << " using delta " << delta_url << " out to " << patched_path_;
+
+    for (int i = 0; i < downloader->retry_count() + 1; ++i) {
+      std::ofstream out(patched_path_.string().c_str(), std::ios_base::binary | std::ios_base::trunc);
+      patch_stream patch(delta_codec->begin_patch(basis->data(), basis->size(), out));
+
+      const bool fetched = downloader->fetch(delta_url, patch, checksum, get_hasher());
+      const rs_result rc = patch.finish();
+
+      out.close();
+
+      if (!fetched) {
+        notice() << "Retry #" << i+1;
+        continue;
+      }
+      else if (rc != RS_DONE || out.fail()) {
+        error()
+          << "Patching file " << basis_path << " using patch " << delta_url
+          <<" has failed. " << delta_codec->name() << " rc: " << rc;
+
+        return STAGE_ENCODING_ERROR;
+      }
+
+      return STAGE_OK;
+    }
+
+    throw invalid_resource(delta_url);
+  }
+
+  STAGE_RC update_operation::apply_chained_deltas() {
+    auto file_manager = config_.file_manager;
+    const path_t previous_path(path_t(patched_path_.string() + ".basis").make_preferred());
+
+    for (size_t i = 0; i < chained_deltas.size(); ++i) {
+      chained_delta_t const& chained_delta = chained_deltas[i];
+      const path_t delta_path(get_chained_delta_path(i));
+
+      if (!file_manager->is_readable(delta_path)) {
+        return STAGE_INVALID_STATE;
+      }
+
+      file_manager->move(patched_path_, previous_path);
+
+      rs_result rc = chained_delta.codec->patch(previous_path, delta_path, patched_path_);
+
+      file_manager->remove_file(previous_path);
+
+      if (rc != RS_DONE) {
+        error()
+          << "Patching file " << basis_path_ << " using chained patch " << delta_path
+          <<" has failed. " << chained_delta.codec->name() << " rc: " << rc;
+
+        return STAGE_ENCODING_ERROR;
+      }
     }
 
     return STAGE_OK;
   }
 
+  path_t update_operation::get_chained_delta_path(size_t index) const {
+    return cache_dir_ / ("delta." + std::to_string(index + 1));
+  }
+
   STAGE_RC update_operation::deploy() {
     auto file_manager = config_.file_manager;
 
-    debug() << "patching file " << basis_path_ << " using delta " << delta_path_ << " out to " << patched_path_;
+    if (!streamed_) {
+      debug() << "patching file " << basis_path_ << " using delta " << delta_path_ << " out to " << patched_path_;
 
-    if (
-      !file_manager->is_readable(basis_path_) ||
-      !file_manager->is_readable(delta_path_)
-    ) {
-      return STAGE_INVALID_STATE;
-    }
+      if (
+        !file_manager->is_readable(basis_path_) ||
+        !file_manager->is_readable(delta_path_)
+      ) {
+        return STAGE_INVALID_STATE;
+      }
 
-    rs_result rc = encoder_.patch(basis_path_.c_str(), delta_path_.c_str(), patched_path_.c_str());
+      rs_result rc = codec->patch(basis_path_, delta_path_, patched_path_);
 
-    if (rc != RS_DONE) {
-      error()
-        << "Patching file " << basis_path_ << " using patch " << delta_path_
-        <<" has failed. librsync rc: " << rc;
+      if (rc != RS_DONE) {
+        error()
+          << "Patching file " << basis_path_ << " using patch " << delta_path_
+          <<" has failed. " << codec->name() << " rc: " << rc;
+
+        return STAGE_ENCODING_ERROR;
+      }
+
+      const STAGE_RC chained_rc = apply_chained_deltas();
 
-      return STAGE_ENCODING_ERROR;
+      if (chained_rc != STAGE_OK) {
+        return chained_rc;
+      }
+    }
+    else if (!file_manager->is_readable(basis_path_)) {
+      return STAGE_INVALID_STATE;
     }
 
-    hasher::digest_rc digest = config_.hasher->hex_digest(patched_path_);
+    hasher::digest_rc digest = get_hasher()->hex_digest(patched_path_);
 
     if (digest != patched_checksum) {
       error()
@@ -155,7 +272,7 @@ namespace kzh {
 
   void update_operation::rollback() {
     auto file_manager = config_.file_manager;
-    auto hasher       = config_.hasher;
+    auto hasher       = get_hasher();
 
     // did we patch the file? keep in mind that if we did:
     //
@@ -200,6 +317,10 @@ namespace kzh {
     cleanup();
   }
 
+  void update_operation::refresh_digests(digest_cache& cache) const {
+    cache.refresh(*get_hasher(), basis_path_, patched_checksum);
+  }
+
   void update_operation::cleanup() {
     auto file_manager = config_.file_manager;
 
@@ -208,12 +329,14 @@ namespace kzh {
       file_manager->remove_file(delta_path_);
     }
 
-    if (file_manager->exists(signature_path_)) {
-      file_manager->remove_file(signature_path_);
-    }
-
     if (file_manager->exists(patched_path_)) {
       file_manager->remove_file(patched_path_);
     }
+
+    for (size_t i = 0; i < chained_deltas.size(); ++i) {
+      if (file_manager->exists(get_chained_delta_path(i))) {
+        file_manager->remove_file(get_chained_delta_path(i));
+      }
+    }
   }
 }
\ No newline at end of file
@@ -19,6 +19,8 @@
  */
 
 #include "karazeh/patcher.hpp"
+#include "karazeh/digest_cache.hpp"
+#include "karazeh/worker_pool.hpp"
 #include <boost/filesystem.hpp>
 
 namespace fs = boost::filesystem;
@@ -57,12 +59,29 @@ namespace kzh {
     // create the cache directory for this release
     file_manager->create_directory(staging_path);
 
-    for (auto op : release.operations) {
-      STAGE_RC rc = op->stage();
+    // Operations stage into their own cache directories, and the only thing
+    // they do to the repository is create the directories of files that are
+    // going to be created, so they can all be staged at the same time. See
+    // #apply_update() for the file_manager calls that have to be thread-safe.
+    const worker_pool workers(config_.concurrency);
+    std::vector<STAGE_RC> stage_rcs(release.operations.size(), STAGE_OK);
+
+    if (workers.size() > 1) {
+      info() << "Staging using " << workers.size() << " workers.";
+    }
+
+    workers.run(release.operations.size(), [&](size_t i) -> bool {
+      stage_rcs[i] = release.operations[i]->stage();
+
+      return stage_rcs[i] == STAGE_OK;
+    });
+
+    for (size_t i = 0; i < release.operations.size(); ++i) {
+      STAGE_RC rc = stage_rcs[i];
 
       if (rc != STAGE_OK) {
         error() << "An operation failed to stage, patch will not be applied.";
-        error() << op->tostring();
+        error() << release.operations[i]->tostring();
         debug() << "STAGE_RC: " << rc;
 
         // TODO: an option to keep the data that has been downloaded would be nice
@@ -91,6 +110,18 @@ namespace kzh {
       op->commit();
     }
 
+    if (config_.cache_digests) {
+      digest_cache cache(config_.cache_path / digest_cache::FILE_NAME);
+
+      cache.load();
+
+      for (auto op : release.operations) {
+        op->refresh_digests(cache);
+      }
+
+      cache.save();
+    }
+
     file_manager->remove_directory(staging_path);
 
     info() << "Patch applied successfully.";
@@ -0,0 +1,316 @@
+/**
+ * karazeh -- the library for patching software
+ *
+ * Copyright (C) 2011-2016 by Ahmad Amireh <ahmad@amireh.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#include "karazeh/release_planner.hpp"
+#include "karazeh/file_manager.hpp"
+#include "karazeh/operations/create.hpp"
+#include "karazeh/operations/delete.hpp"
+#include "karazeh/operations/update.hpp"
+#include <algorithm>
+#include <map>
+
+namespace kzh {
+  namespace {
+    enum file_state_t {
+      /** None of the releases so far touch the file */
+      FILE_UNTOUCHED,
+      /** The file is gone; it was deleted, or created and then deleted */
+      FILE_REMOVED,
+      /** The file is created, and maybe updated afterwards */
+      FILE_CREATED,
+      /** The file the application has is updated */
+      FILE_UPDATED
+    };
+
+    /** What the releases of a plan do to a file, all told */
+    struct file_plan_t {
+      file_state_t state;
+
+      /** Position of the file among those of the plan, for ordering */
+      size_t order;
+
+      /** The operation deleting the file the application has, if any */
+      delete_operation const* removal;
+      create_operation const* creation;
+
+      /** Updates of the created file, or of the one the application has */
+      std::vector<update_operation const*> updates;
+    };
+
+    typedef std::map<string_t, file_plan_t> file_plans_t;
+
+    /** Whether a file is inside a directory of the plan, or the other way around */
+    bool is_nested(file_plans_t const& files, string_t const& key) {
+      for (path_t parent = path_t(key).parent_path(); parent.has_relative_path(); parent = parent.parent_path()) {
+        if (files.count(parent.generic_string())) {
+          return true;
+        }
+      }
+
+      auto descendant = files.lower_bound(key + '/');
+
+      return descendant != files.end() && descendant->first.compare(0, key.size() + 1, key + '/') == 0;
+    }
+
+    /** The checksum of a file once all the operations planned so far are done */
+    string_t const& planned_checksum(file_plan_t const& file) {
+      if (!file.updates.empty()) {
+        return file.updates.back()->patched_checksum;
+      }
+
+      return file.creation->chained_deltas.empty() ? file.creation->src_checksum : file.creation->patched_checksum;
+    }
+
+    /** Appends the deltas of an update to those of another operation */
+    void chain(update_operation const& update, std::vector<chained_delta_t>& deltas, string_t& patched_checksum) {
+      deltas.push_back(chained_delta_t { update.delta_url(), update.delta_checksum, update.codec });
+      deltas.insert(deltas.end(), update.chained_deltas.begin(), update.chained_deltas.end());
+      patched_checksum = update.patched_checksum;
+    }
+  }
+
+  struct release_planner::plan_t {
+    inline plan_t() : hasher(nullptr), nr_files(0) {};
+
+    std::vector<release_manifest const*> releases;
+    file_plans_t files;
+    kzh::hasher const* hasher;
+    size_t nr_files;
+  };
+
+  release_planner::release_planner(config_t const& config)
+  : logger("release_planner"),
+    config_(config)
+  {
+  }
+
+  release_planner::~release_planner() {
+    while (!releases_.empty()) {
+      delete releases_.back();
+      releases_.pop_back();
+    }
+  }
+
+  std::vector<release_manifest const*>
+  release_planner::coalesce(std::vector<release_manifest const*> const& releases) {
+    std::vector<release_manifest const*> coalesced;
+    plan_t plan;
+
+    const auto flush = [&]() {
+      if (plan.releases.size() == 1) {
+        coalesced.push_back(plan.releases.front());
+      }
+      else if (plan.releases.size() > 1) {
+        releases_.push_back(make_release(plan));
+        coalesced.push_back(releases_.back());
+
+        info()
+          << "Coalesced " << plan.releases.size() << " releases into one with "
+          << releases_.back()->operations.size() << " operations.";
+      }
+
+      plan = plan_t();
+    };
+
+    for (auto release : releases) {
+      if (!fold(plan, *release)) {
+        flush();
+
+        // not even on its own, it goes as it is
+        if (!fold(plan, *release)) {
+          coalesced.push_back(release);
+        }
+      }
+    }
+
+    flush();
+
+    return coalesced;
+  }
+
+  bool
+  release_planner::fold(plan_t& plan, release_manifest const& release) const {
+    const kzh::hasher *hasher = release.hasher ? release.hasher : config_.hasher;
+
+    if (!plan.releases.empty() && hasher != plan.hasher) {
+      return false;
+    }
+
+    // the files the release touches are worked on aside, and only make it
+    // into the plan if all of its operations fold in
+    file_plans_t files;
+    size_t nr_files = plan.nr_files;
+
+    const auto find_file = [&](path_t const& path) -> file_plan_t* {
+      const string_t key(file_manager::normalize(path).generic_string());
+      auto file = files.find(key);
+
+      if (file != files.end()) {
+        return &file->second;
+      }
+
+      auto planned = plan.files.find(key);
+
+      if (planned != plan.files.end()) {
+        return &(files[key] = planned->second);
+      }
+      else if (is_nested(plan.files, key) || is_nested(files, key)) {
+        return nullptr;
+      }
+
+      return &(files[key] = file_plan_t { FILE_UNTOUCHED, nr_files++, nullptr, nullptr, {} });
+    };
+
+    for (auto op : release.operations) {
+      if (auto removal = dynamic_cast<delete_operation const*>(op)) {
+        file_plan_t *file = find_file(config_.root_path / removal->dst_path);
+
+        if (!file || file->state == FILE_REMOVED) {
+          return false;
+        }
+        else if (file->state != FILE_CREATED) {
+          file->removal = removal;
+        }
+
+        file->state = FILE_REMOVED;
+        file->creation = nullptr;
+        file->updates.clear();
+      }
+      else if (auto creation = dynamic_cast<create_operation const*>(op)) {
+        file_plan_t *file = find_file(config_.root_path / creation->dst_path);
+
+        if (!file || (file->state != FILE_UNTOUCHED && file->state != FILE_REMOVED)) {
+          return false;
+        }
+
+        file->state = FILE_CREATED;
+        file->creation = creation;
+      }
+      else if (auto update = dynamic_cast<update_operation const*>(op)) {
+        file_plan_t *file = find_file(update->basis_path());
+
+        if (
+          !file ||
+          file->state == FILE_REMOVED ||
+          (file->state != FILE_UNTOUCHED && planned_checksum(*file) != update->basis_checksum)
+        ) {
+          return false;
+        }
+
+        if (file->state == FILE_UNTOUCHED) {
+          file->state = FILE_UPDATED;
+        }
+
+        file->updates.push_back(update);
+      }
+      else {
+        return false;
+      }
+    }
+
+    for (auto& file : files) {
+      plan.files[file.first] = std::move(file.second);
+    }
+
+    plan.releases.push_back(&release);
+    plan.hasher = hasher;
+    plan.nr_files = nr_files;
+
+    return true;
+  }
+
+  release_manifest*
+  release_planner::make_release(plan_t const& plan) const {
+    release_manifest const& first = *plan.releases.front();
+    release_manifest const& last = *plan.releases.back();
+    release_manifest *release = new release_manifest();
+
+    release->id = last.id;
+    release->head = first.head;
+    release->identity = last.identity;
+    release->tag = last.tag;
+    release->target = last.target;
+    release->hasher = first.hasher;
+
+    for (auto folded : plan.releases) {
+      release->size += folded->size;
+    }
+
+    std::vector<file_plan_t const*> files;
+
+    for (auto const& file : plan.files) {
+      files.push_back(&file.second);
+    }
+
+    std::sort(files.begin(), files.end(), [](file_plan_t const* a, file_plan_t const* b) {
+      return a->order < b->order;
+    });
+
+    int operation_id = 0;
+
+    for (auto file : files) {
+      if (file->removal) {
+        auto op = new delete_operation(++operation_id, config_, *release);
+
+        op->dst_path = file->removal->dst_path;
+
+        release->operations.push_back(op);
+      }
+
+      if (file->creation) {
+        auto op = new create_operation(++operation_id, config_, *release);
+
+        op->src_uri = file->creation->src_uri;
+        op->src_checksum = file->creation->src_checksum;
+        op->dst_path = file->creation->dst_path;
+        op->is_executable = file->creation->is_executable;
+        op->chained_deltas = file->creation->chained_deltas;
+        op->patched_checksum = file->creation->patched_checksum;
+
+        if (file->removal) {
+          op->marked_for_deletion();
+        }
+
+        for (auto update : file->updates) {
+          chain(*update, op->chained_deltas, op->patched_checksum);
+        }
+
+        release->operations.push_back(op);
+      }
+      else if (!file->updates.empty()) {
+        update_operation const& update = *file->updates.front();
+        auto op = new update_operation(++operation_id, config_, *release, update.basis_path(), update.delta_url());
+
+        op->basis_checksum = update.basis_checksum;
+        op->delta_checksum = update.delta_checksum;
+        op->patched_checksum = update.patched_checksum;
+        op->codec = update.codec;
+        op->chained_deltas = update.chained_deltas;
+
+        for (size_t i = 1; i < file->updates.size(); ++i) {
+          chain(*file->updates[i], op->chained_deltas, op->patched_checksum);
+        }
+
+        release->operations.push_back(op);
+      }
+    }
+
+    return release;
+  }
+}
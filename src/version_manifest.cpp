@@ -19,6 +19,11 @@
  */
 
 #include "karazeh/version_manifest.hpp"
+#include "karazeh/digest_cache.hpp"
+#include "karazeh/worker_pool.hpp"
+#include <algorithm>
+#include <functional>
+#include <queue>
 
 namespace kzh {
   typedef file_manager file_manager_t;
@@ -73,7 +78,8 @@ namespace kzh {
   };
 
   version_manifest::version_manifest(config_t const& config)
-  : config_(config) {
+  : config_(config),
+    hasher_(nullptr) {
   }
 
   version_manifest::~version_manifest() {
@@ -148,6 +154,16 @@ namespace kzh {
       throw invalid_manifest("Version manifest must contain at least one release entry.");
     }
 
+    if (!manifest["hasher"].is_null()) {
+      const string_t &hasher_name = manifest["hasher"].string_value();
+
+      hasher_ = hasher_t::find(hasher_name);
+
+      if (hasher_ == nullptr) {
+        throw invalid_manifest("Version manifest uses an unknown hasher (" + hasher_name + ").");
+      }
+    }
+
     for (auto identity_list_node : identity_list_nodes) {
       validate_schema(identity_list_node, SCHEMA_IDENTITY_LIST);
 
@@ -207,28 +223,59 @@ namespace kzh {
 
   string_t
   version_manifest::get_current_version() const {
-    const hasher_t *hasher = config_.hasher;
+    const hasher_t *hasher = get_hasher();
     const file_manager_t *file_manager = config_.file_manager;
 
-    map<string_t, string_t> versions;
+    // identity lists tend to share files, like the main executable, so every
+    // file is digested once no matter how many lists it's in
+    map<path_t, size_t> file_indices;
+    vector<path_t> files;
 
-    for (auto identity_list_entry : identity_lists_) {
-      string_t list_checksum;
+    for (auto const& identity_list_entry : identity_lists_) {
+      for (auto const& identity_file : identity_list_entry.second.files) {
+        if (file_indices.insert({ identity_file, files.size() }).second) {
+          files.push_back(identity_file);
+        }
+      }
+    }
 
-      auto identity_list = identity_list_entry.second;
+    vector<string_t> digests(files.size());
+    const worker_pool workers(config_.concurrency);
+    std::unique_ptr<digest_cache> cache;
 
-      for (auto identity_file : identity_list.files) {
-        if (!file_manager->is_readable(identity_file)) {
-          throw std::domain_error("Identity file " + identity_file.string() + " is not readable.");
-        }
+    if (config_.cache_digests) {
+      cache.reset(new digest_cache(config_.cache_path / digest_cache::FILE_NAME));
+      cache->load();
+    }
 
-        hasher_t::digest_rc rc = hasher->hex_digest(identity_file);
+    workers.run(files.size(), [&](size_t i) {
+      if (!file_manager->is_readable(files[i])) {
+        throw std::domain_error("Identity file " + files[i].string() + " is not readable.");
+      }
 
-        if (!rc.valid) {
-          throw std::domain_error("Identity file " + identity_file.string() + " could not be digested.");
-        }
+      hasher_t::digest_rc rc = cache ? cache->hex_digest(*hasher, files[i]) : hasher->hex_digest(files[i]);
+
+      if (!rc.valid) {
+        throw std::domain_error("Identity file " + files[i].string() + " could not be digested.");
+      }
+
+      digests[i] = rc.digest;
 
-        list_checksum += rc.digest;
+      return true;
+    });
+
+    if (cache) {
+      cache->save();
+    }
+
+    map<string_t, string_t> versions;
+
+    for (auto const& identity_list_entry : identity_lists_) {
+      identity_list_t const& identity_list = identity_list_entry.second;
+      string_t list_checksum;
+
+      for (auto const& identity_file : identity_list.files) {
+        list_checksum += digests[file_indices.find(identity_file)->second];
       }
 
       versions.insert({
@@ -241,6 +288,12 @@ namespace kzh {
     // the release entries and attempt to find one whose checksum matches that
     // of the identity list it points to
     for (auto release : releases_) {
+      // cumulative releases are named after the versions they bridge rather
+      // than the one they lead to, which is listed on its own anyway
+      if (!release->target.empty()) {
+        continue;
+      }
+
       const string_t &release_checksum = release->id;
       const string_t &identity_list_name = release->identity;
       const string_t &identity_list_checksum = versions.find(identity_list_name)->second;
@@ -255,18 +308,88 @@ namespace kzh {
 
   vector<string_t>
   version_manifest::get_available_updates(string_t const &current_version) const {
-    // we'll use the map for fast look-ups and off-load into a list at output
-    // time
-    map<string_t, const release_manifest*> update_map;
+    // the cheapest way found to a version: how many bytes and releases it
+    // takes, and the release it's reached through
+    struct route_t {
+      uint64_t bytes;
+      size_t releases;
+      size_t through;
+    };
+
+    typedef std::pair<uint64_t, size_t> cost_t;
+    typedef std::pair<cost_t, string_t> pending_t;
+
+    const size_t none = releases_.size();
+    std::unordered_map<string_t, route_t> routes;
+    std::priority_queue<pending_t, vector<pending_t>, std::greater<pending_t>> pending;
+    const string_t *latest = nullptr;
+    size_t latest_rank = 0;
+    bool latest_is_tip = false;
+
+    routes.insert({ current_version, route_t { 0, 0, none } });
+    pending.push({ cost_t(0, 0), current_version });
+
+    // Dijkstra's, over versions rather than releases since cumulative ones
+    // lead to the same version as the chain of releases they stand in for
+    while (!pending.empty()) {
+      const cost_t cost = pending.top().first;
+      const string_t version = pending.top().second;
+      auto const& route = *routes.find(version);
+
+      pending.pop();
+
+      if (cost != cost_t(route.second.bytes, route.second.releases)) {
+        continue;
+      }
+
+      auto children = releases_by_head_.find(version);
+
+      // the latest version is one that nothing leads out of, the last one
+      // listed if there are several or none at all
+      if (route.second.through != none) {
+        const bool is_tip = children == releases_by_head_.end();
+        auto listed = release_indices_.find(version);
+        const size_t rank = listed != release_indices_.end() ? listed->second : route.second.through;
+
+        if (!latest || (is_tip && !latest_is_tip) || (is_tip == latest_is_tip && rank > latest_rank)) {
+          latest = &route.first;
+          latest_rank = rank;
+          latest_is_tip = is_tip;
+        }
+      }
+
+      if (children == releases_by_head_.end()) {
+        continue;
+      }
+
+      for (size_t child : children->second) {
+        const release_manifest *release = releases_[child];
+        const string_t &target = release->target.empty() ? release->id : release->target;
+        const cost_t target_cost(cost.first + release->size, cost.second + 1);
+        auto known = routes.find(target);
+
+        if (known == routes.end()) {
+          routes.insert({ target, route_t { target_cost.first, target_cost.second, child } });
+          pending.push({ target_cost, target });
+        }
+        else if (target_cost < cost_t(known->second.bytes, known->second.releases)) {
+          known->second = route_t { target_cost.first, target_cost.second, child };
+          pending.push({ target_cost, target });
+        }
+      }
+    }
+
     vector<string_t> update_list;
 
-    for (auto release : releases_) {
-      if (release->head == current_version || update_map.find(release->head) != update_map.end()) {
-        update_list.push_back(release->id);
-        update_map.insert({ release->id, release });
+    if (latest) {
+      for (size_t index = routes.find(*latest)->second.through; index != none;) {
+        update_list.push_back(releases_[index]->id);
+        index = routes.find(releases_[index]->head)->second.through;
       }
     }
 
+    std::reverse(update_list.begin(), update_list.end());
+
     return update_list;
   }
 
@@ -286,20 +409,28 @@ namespace kzh {
       );
     }
 
+    const JSON &size_node = release_node["size"];
+
+    if (!size_node.is_null() && (!size_node.is_number() || size_node.number_value() < 0)) {
+      throw invalid_manifest(
+        "Release (" + release_node["id"].string_value() + ") has an invalid size."
+      );
+    }
+
     release_manifest *release(nullptr);
     bool owned = false;
+    auto existing_release = release_indices_.find(release_node["id"].string_value());
 
-    for (auto existing_release : releases_) {
-      if (existing_release->id == release_node["id"].string_value()) {
-        release = existing_release;
-      }
+    if (existing_release != release_indices_.end()) {
+      release = releases_[existing_release->second];
     }
-
-    if (release == nullptr) {
+    else {
       release = new release_manifest();
       owned = true;
     }
 
+    const bool had_head = !release->head.empty();
+
     try {
       if (release->identity.empty()) {
         release->identity = release_node["identity"].string_value();
@@ -321,6 +452,18 @@ namespace kzh {
         release->uri = release_node["uri"].string_value();
       }
 
+      if (release->target.empty()) {
+        release->target = release_node["target"].string_value();
+      }
+
+      if (release->size == 0) {
+        release->size = static_cast<uint64_t>(size_node.number_value());
+      }
+
+      if (release->hasher == nullptr) {
+        release->hasher = hasher_;
+      }
+
       int operation_id = 0;
 
       for (auto operation_node : operation_nodes) {
@@ -338,14 +481,22 @@ namespace kzh {
       if (owned) {
         delete release;
       }
+      else if (!had_head) {
+        release->head.clear();
+      }
 
       throw;
     }
 
     if (owned) {
+      release_indices_.insert({ release->id, releases_.size() });
       releases_.push_back(release);
     }
 
+    if (!had_head && !release->head.empty()) {
+      releases_by_head_[release->head].push_back(release_indices_.find(release->id)->second);
+    }
+
     return release;
   }
 
@@ -404,6 +555,21 @@ namespace kzh {
       op->patched_checksum = operation_node["basis"]["post_checksum"].string_value();
       op->delta_checksum = operation_node["delta"]["checksum"].string_value();
 
+      // "block_length" and "strong_length" only record how the delta was
+      // generated; patching doesn't need them, so they aren't read here
+
+      // the codec the delta was encoded with, librsync's unless named
+      const JSON &encoding = operation_node["delta"]["encoding"];
+
+      if (!encoding.is_null()) {
+        op->codec = encoding.is_string() ? delta_codec::find(encoding.string_value()) : nullptr;
+
+        if (!op->codec) {
+          delete op;
+          throw invalid_manifest("Update operation has an unknown delta encoding.");
+        }
+      }
+
       return op;
     }
     else if (operation_type == "delete") {
@@ -421,12 +587,13 @@ namespace kzh {
 
   const release_manifest*
   version_manifest::get_release(string_t const& id) const {
-    for (auto existing_release : releases_) {
-      if (existing_release->id == id) {
-        return existing_release;
-      }
-    }
+    auto index = release_indices_.find(id);
 
-    return nullptr;
+    return index != release_indices_.end() ? releases_[index->second] : nullptr;
+  }
+
+  hasher const*
+  version_manifest::get_hasher() const {
+    return hasher_ ? hasher_ : config_.hasher;
   }
-}
\ No newline at end of file
+}
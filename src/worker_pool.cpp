@@ -0,0 +1,98 @@
+/**
+ * karazeh -- the library for patching software
+ *
+ * Copyright (C) 2011-2016 by Ahmad Amireh <ahmad@amireh.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "karazeh/worker_pool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace kzh {
+  worker_pool::worker_pool(int size)
+  : size_(size > 1 ? size : 1)
+  {
+  }
+
+  worker_pool::~worker_pool() {
+  }
+
+  int worker_pool::size() const {
+    return size_;
+  }
+
+  bool worker_pool::run(size_t count, task_t const& task) const {
+    if (size_ == 1 || count < 2) {
+      for (size_t i = 0; i < count; ++i) {
+        if (!task(i)) {
+          return false;
+        }
+      }
+
+      return true;
+    }
+
+    std::atomic<size_t> cursor(0);
+    std::atomic<bool>   failed(false);
+    std::exception_ptr  exception;
+    std::mutex          exception_mutex;
+
+    const auto work = [&]() {
+      size_t i;
+
+      while (!failed && (i = cursor++) < count) {
+        try {
+          if (!task(i)) {
+            failed = true;
+          }
+        }
+        catch (...) {
+          std::lock_guard<std::mutex> lock(exception_mutex);
+
+          if (!exception) {
+            exception = std::current_exception();
+          }
+
+          failed = true;
+        }
+      }
+    };
+
+    const size_t nr_workers = std::min(count, static_cast<size_t>(size_));
+    std::vector<std::thread> workers;
+
+    workers.reserve(nr_workers);
+
+    for (size_t i = 0; i < nr_workers; ++i) {
+      workers.push_back(std::thread(work));
+    }
+
+    for (auto &worker : workers) {
+      worker.join();
+    }
+
+    if (exception) {
+      std::rethrow_exception(exception);
+    }
+
+    return !failed;
+  }
+}
@@ -11,12 +11,26 @@
 #include <cstdlib>
 
 static std::string get_env_var(std::string const& key, std::string const& default_value = "");
+static int run_tests(int argc, char **argv);
 
 kzh::test_config_t  kzh::test_config; // TEST GLOBAL
 kzh::config_t       kzh::sample_config; // TEST GLOBAL
 
 int main(int argc, char **argv) {
   int result;
+
+  curl_global_init(CURL_GLOBAL_ALL);
+
+  // the downloader must be gone by the time curl is cleaned up
+  result = run_tests(argc, argv);
+
+  curl_global_cleanup();
+
+  return result;
+}
+
+int run_tests(int argc, char **argv) {
+  int result;
   const bool verbose = get_env_var("VERBOSE") == "1";
 
   kzh::md5_hasher     hasher;
@@ -40,6 +54,9 @@ int main(int argc, char **argv) {
   kzh::sample_config.file_manager = &file_manager;
   kzh::sample_config.downloader = &downloader;
   kzh::sample_config.verbose = verbose;
+  kzh::sample_config.concurrency = 4;
+  kzh::sample_config.stream_patches = false;
+  kzh::sample_config.cache_digests = false;
 
   file_manager.ensure_directory(kzh::test_config.temp_path);
   file_manager.ensure_directory(kzh::sample_config.cache_path);
@@ -52,12 +69,8 @@ int main(int argc, char **argv) {
     kzh::logger::mute();
   }
 
-  curl_global_init(CURL_GLOBAL_ALL);
-
   result = Catch::Session().run( argc, argv );
 
-  curl_global_cleanup();
-
   if (get_env_var("ARTIFACTS") != "1") {
     file_manager.remove_directory(kzh::test_config.temp_path);
     file_manager.remove_directory(kzh::sample_config.cache_path.parent_path()); // the .kzh directory
@@ -0,0 +1,428 @@
+#include "karazeh/karazeh.hpp"
+#include "karazeh/delta_encoder.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <vector>
+
+extern "C" {
+  #include "librsync-2.0.0/src/sumset.h"
+  #include "librsync-2.0.0/src/search.h"
+  #include "librsync-2.0.0/src/checksum.h"
+  #include "librsync-2.0.0/src/rollsum.h"
+}
+
+/**
+ * Measures how long librsync takes to index a signature and to search it
+ * while generating a delta. The basis is random data and it is diffed
+ * against two files: the basis with small edits sprinkled over it, so nearly
+ * every block matches but not at the offset it used to be at, and unrelated
+ * random data of the same size, where every byte position is a failed lookup.
+ *
+ * Lookups are timed twice through the same scanning loop: once with the
+ * sorted tag table librsync 2.0.0 shipped with, kept below as the baseline,
+ * and once with the bundled open-addressing table. Whole deltas are then
+ * generated with the bundled librsync.
+ *
+ * Usage: kzh-bench-delta-search [BLOCK_COUNT [BLOCK_LENGTH [RUNS]]]
+ */
+
+typedef std::chrono::steady_clock clock_type;
+
+static double seconds_since(clock_type::time_point start) {
+  return std::chrono::duration<double>(clock_type::now() - start).count();
+}
+
+/**
+ * The index of librsync 2.0.0's search.c: blocks sorted by a 16-bit tag of
+ * their weak sum, then by weak and strong sum, with a table of the range of
+ * every tag, and a binary search within it.
+ */
+class pristine_index {
+public:
+  explicit pristine_index(rs_signature_t const* sig)
+  : sig_(sig),
+    tag_table_(TABLE_SIZE, tag_range_t { NULL_TAG, NULL_TAG }),
+    targets_(sig->count)
+  {
+    for (int i = 0; i < sig->count; ++i) {
+      targets_[i].i = i;
+      targets_[i].t = gettag(sig->block_sigs[i].weak_sum);
+    }
+
+    if (sig->count > 0) {
+      heap_sort();
+    }
+
+    for (int i = sig->count - 1; i >= 0; i--) {
+      tag_table_[targets_[i].t].l = i;
+    }
+
+    for (int i = 0; i < sig->count; i++) {
+      tag_table_[targets_[i].t].r = i;
+    }
+  }
+
+  int search(rs_weak_sum_t weak_sum, const rs_byte_t *inbuf, size_t block_len, rs_long_t *match_where) const {
+    rs_strong_sum_t strong_sum;
+    int got_strong = 0;
+    tag_range_t const& bucket = tag_table_[gettag(weak_sum)];
+    int l = bucket.l;
+    int r = bucket.r + 1;
+    int v = 1;
+
+    if (l == NULL_TAG) {
+      return 0;
+    }
+
+    while (l < r) {
+      int m = (l + r) >> 1;
+      rs_block_sig_t *b = &sig_->block_sigs[targets_[m].i];
+
+      v = (weak_sum > b->weak_sum) - (weak_sum < b->weak_sum);
+
+      if (v == 0) {
+        if (!got_strong) {
+          strong(inbuf, block_len, &strong_sum);
+          got_strong = 1;
+        }
+
+        v = memcmp(strong_sum, b->strong_sum, sig_->strong_sum_len);
+
+        if (v == 0) {
+          l = m;
+          r = m;
+          break;
+        }
+      }
+
+      if (v > 0) {
+        l = m + 1;
+      }
+      else {
+        r = m;
+      }
+    }
+
+    if (l == r && l <= bucket.r) {
+      rs_block_sig_t *b = &sig_->block_sigs[targets_[l].i];
+
+      if (weak_sum != b->weak_sum) {
+        return 0;
+      }
+
+      if (!got_strong) {
+        strong(inbuf, block_len, &strong_sum);
+      }
+
+      v = memcmp(strong_sum, b->strong_sum, sig_->strong_sum_len);
+      *match_where = (rs_long_t)(b->i - 1) * sig_->block_len;
+    }
+
+    return !v;
+  }
+
+private:
+  enum { TABLE_SIZE = 1 << 16, NULL_TAG = -1 };
+
+  struct tag_range_t {
+    int l;
+    int r;
+  };
+
+  struct target_t {
+    unsigned short t;
+    int i;
+  };
+
+  static unsigned short gettag(rs_weak_sum_t sum) {
+    return static_cast<unsigned short>(((sum & 0xFFFF) + (sum >> 16)) & 0xFFFF);
+  }
+
+  void strong(const rs_byte_t *inbuf, size_t block_len, rs_strong_sum_t *sum) const {
+    if (sig_->magic == RS_BLAKE2_SIG_MAGIC) {
+      rs_calc_blake2_sum(inbuf, block_len, sum);
+    }
+    else {
+      rs_calc_md4_sum(inbuf, block_len, sum);
+    }
+  }
+
+  int compare(target_t const& t1, target_t const& t2) const {
+    int v = (int) t1.t - (int) t2.t;
+
+    if (v != 0) {
+      return v;
+    }
+
+    rs_weak_sum_t w1 = sig_->block_sigs[t1.i].weak_sum;
+    rs_weak_sum_t w2 = sig_->block_sigs[t2.i].weak_sum;
+
+    v = (w1 > w2) - (w1 < w2);
+
+    if (v != 0) {
+      return v;
+    }
+
+    return memcmp(sig_->block_sigs[t1.i].strong_sum, sig_->block_sigs[t2.i].strong_sum, sig_->strong_sum_len);
+  }
+
+  void heap_sort() {
+    unsigned int i, j, n, k, p;
+    const unsigned int count = sig_->count;
+
+    for (i = 1; i < count; ++i) {
+      for (j = i; j > 0;) {
+        p = (j - 1) >> 1;
+
+        if (compare(targets_[j], targets_[p]) > 0) {
+          std::swap(targets_[j], targets_[p]);
+        }
+        else {
+          break;
+        }
+
+        j = p;
+      }
+    }
+
+    for (n = count - 1; n > 0;) {
+      std::swap(targets_[0], targets_[n]);
+      --n;
+
+      for (i = 0; ((i << 1) + 1) <= n;) {
+        k = (i << 1) + 1;
+
+        if ((k + 1 <= n) && (compare(targets_[k], targets_[k + 1]) < 0)) {
+          k = k + 1;
+        }
+
+        if (compare(targets_[k], targets_[i]) > 0) {
+          std::swap(targets_[k], targets_[i]);
+        }
+        else {
+          break;
+        }
+
+        i = k;
+      }
+    }
+  }
+
+  rs_signature_t const* sig_;
+  std::vector<tag_range_t> tag_table_;
+  std::vector<target_t> targets_;
+};
+
+/** Fills a buffer with bytes from the generator */
+static void randomize(std::string& buffer, std::mt19937& rng) {
+  for (size_t i = 0; i < buffer.size(); ++i) {
+    buffer[i] = static_cast<char>(rng());
+  }
+}
+
+/** Feeds a whole buffer to a librsync job, keeping whatever it puts out */
+static rs_result run_job(rs_job_t *job, std::string const& in, std::string *out) {
+  std::vector<char> out_buffer(1 << 20);
+  rs_buffers_t buffers;
+  rs_result result;
+
+  std::memset(&buffers, 0, sizeof(buffers));
+
+  buffers.next_in = const_cast<char*>(in.data());
+  buffers.avail_in = in.size();
+  buffers.eof_in = 1;
+
+  do {
+    buffers.next_out = &out_buffer[0];
+    buffers.avail_out = out_buffer.size();
+
+    result = rs_job_iter(job, &buffers);
+
+    if (out) {
+      out->append(&out_buffer[0], out_buffer.size() - buffers.avail_out);
+    }
+  } while (result == RS_BLOCKED);
+
+  return result;
+}
+
+/** Loads a signature, leaving it to the caller to index and free */
+static rs_signature_t* load_signature(std::string const& signature) {
+  rs_signature_t *sumset = NULL;
+  rs_job_t *job = rs_loadsig_begin(&sumset);
+
+  run_job(job, signature, NULL);
+  rs_job_free(job);
+
+  return sumset;
+}
+
+/**
+ * Walks a file the way delta generation does, rolling the weak sum a byte at
+ * a time and skipping a whole block on every match.
+ *
+ * @return The number of blocks matched
+ */
+template <typename Search>
+static size_t scan(std::string const& data, size_t block_length, Search const& search) {
+  const rs_byte_t *bytes = reinterpret_cast<const rs_byte_t*>(data.data());
+  size_t matches = 0;
+  size_t position = 0;
+  bool rolling = false;
+  Rollsum sum;
+
+  while (position + block_length <= data.size()) {
+    if (!rolling) {
+      RollsumInit(&sum);
+      RollsumUpdate(&sum, bytes + position, block_length);
+      rolling = true;
+    }
+
+    rs_long_t match_where;
+
+    if (search(static_cast<rs_weak_sum_t>(RollsumDigest(&sum)), bytes + position, block_length, &match_where)) {
+      ++matches;
+      position += block_length;
+      rolling = false;
+    }
+    else {
+      if (position + block_length < data.size()) {
+        RollsumRotate(&sum, bytes[position], bytes[position + block_length]);
+      }
+
+      ++position;
+    }
+  }
+
+  return matches;
+}
+
+int main(int argc, char** argv) {
+  const size_t block_count = argc > 1 ? std::atoi(argv[1]) : 100000;
+  const size_t block_length = argc > 2 ? std::atoi(argv[2]) : 1024;
+  const int runs = argc > 3 ? std::atoi(argv[3]) : 3;
+
+  std::mt19937 rng(42);
+  std::string basis(block_count * block_length, '\0');
+
+  randomize(basis, rng);
+
+  // insert a few bytes every 64 KiB or so, shifting everything after them
+  std::string edited;
+
+  edited.reserve(basis.size() + basis.size() / 4096);
+
+  for (size_t offset = 0; offset < basis.size(); offset += 65536) {
+    edited.append(basis, offset, 65536);
+    edited.append(1 + rng() % 7, static_cast<char>(rng()));
+  }
+
+  std::string unrelated(basis.size(), '\0');
+
+  randomize(unrelated, rng);
+
+  const char* names[] = { "edited", "unrelated" };
+  std::string const* new_files[] = { &edited, &unrelated };
+
+  std::stringstream signature_stream;
+  std::istringstream basis_stream(basis);
+  kzh::delta_encoder encoder;
+
+  if (encoder.signature(basis_stream, signature_stream, kzh::signature_options_t(block_length, 8)) != RS_DONE) {
+    std::cerr << "Unable to generate the signature" << std::endl;
+    return 1;
+  }
+
+  const std::string signature(signature_stream.str());
+
+  std::cout
+    << block_count << " blocks of " << block_length << " bytes, "
+    << (basis.size() >> 20) << " MiB" << std::endl;
+
+  for (int run = 0; run < runs * 2; ++run) {
+    std::string const& new_file = *new_files[run % 2];
+    const double mib = static_cast<double>(new_file.size()) / (1 << 20);
+    rs_signature_t *sumset = load_signature(signature);
+    rs_stats_t stats;
+
+    std::memset(&stats, 0, sizeof(stats));
+
+    // the baseline: librsync 2.0.0's sorted tag table
+    clock_type::time_point start = clock_type::now();
+    const pristine_index pristine(sumset);
+    const double pristine_index_time = seconds_since(start);
+
+    start = clock_type::now();
+
+    const size_t pristine_matches = scan(new_file, block_length,
+      [&](rs_weak_sum_t weak_sum, const rs_byte_t *inbuf, size_t length, rs_long_t *where) {
+        return pristine.search(weak_sum, inbuf, length, where);
+      });
+
+    const double pristine_search_time = seconds_since(start);
+
+    // the bundled open-addressing table
+    start = clock_type::now();
+
+    if (rs_build_hash_table(sumset) != RS_DONE) {
+      std::cerr << "Unable to build the hash table" << std::endl;
+      return 1;
+    }
+
+    const double index_time = seconds_since(start);
+
+    start = clock_type::now();
+
+    const size_t matches = scan(new_file, block_length,
+      [&](rs_weak_sum_t weak_sum, const rs_byte_t *inbuf, size_t length, rs_long_t *where) {
+        return rs_search_for_block(weak_sum, inbuf, length, sumset, &stats, where);
+      });
+
+    const double search_time = seconds_since(start);
+
+    rs_free_sumset(sumset);
+
+    // a whole delta with the bundled librsync
+    sumset = load_signature(signature);
+
+    std::string delta;
+
+    if (rs_build_hash_table(sumset) != RS_DONE) {
+      std::cerr << "Unable to build the hash table" << std::endl;
+      return 1;
+    }
+
+    start = clock_type::now();
+
+    rs_job_t *job = rs_delta_begin(sumset);
+
+    if (run_job(job, new_file, &delta) != RS_DONE) {
+      std::cerr << "Unable to generate the delta" << std::endl;
+      return 1;
+    }
+
+    const double delta_time = seconds_since(start);
+
+    rs_job_free(job);
+    rs_free_sumset(sumset);
+
+    std::cout
+      << "run " << run / 2 + 1 << " " << names[run % 2] << ":" << std::endl
+      << "  pristine: index " << pristine_index_time * 1000 << " ms, "
+      << "search " << mib / pristine_search_time << " MiB/s, "
+      << pristine_matches << " matches" << std::endl
+      << "  bundled:  index " << index_time * 1000 << " ms, "
+      << "search " << mib / search_time << " MiB/s, "
+      << matches << " matches" << std::endl
+      << "  delta " << delta_time * 1000 << " ms "
+      << "(" << mib / delta_time << " MiB/s), "
+      << "delta size " << delta.size() << " bytes"
+      << std::endl;
+  }
+
+  return 0;
+}
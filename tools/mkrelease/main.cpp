@@ -0,0 +1,665 @@
+#include "karazeh/karazeh.hpp"
+#include "karazeh/cdc_encoder.hpp"
+#include "karazeh/delta_encoder.hpp"
+#include "karazeh/file_manager.hpp"
+#include "karazeh/hasher.hpp"
+#include "karazeh/logger.hpp"
+#include "karazeh/worker_pool.hpp"
+#include "json11/json11.hpp"
+#include <boost/filesystem.hpp>
+#include <cerrno>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace fs = boost::filesystem;
+using kzh::string_t;
+using kzh::path_t;
+using json11::Json;
+
+typedef struct {
+  path_t old_tree;
+  path_t new_tree;
+  path_t output_path;
+  string_t id;
+  string_t tag;
+  string_t head;
+  string_t target;
+  string_t identity;
+  string_t url_prefix;
+  kzh::hasher const* hasher;
+  kzh::delta_codec const* codec;
+  kzh::signature_options_t signature_options;
+  int concurrency;
+} options_t;
+
+/** A file found in either of the trees, or both */
+typedef struct {
+  /** Path relative to the tree, like "/bin/app" */
+  string_t path;
+
+  bool in_old;
+  bool in_new;
+  bool executable;
+
+  string_t old_checksum;
+  string_t new_checksum;
+  kzh::uint64_t new_size;
+
+  /** Set when the file changed and a delta is worth shipping */
+  bool has_delta;
+  string_t delta_checksum;
+  kzh::uint64_t delta_size;
+} entry_t;
+
+static kzh::logger logger("mkrelease");
+
+static void print_usage();
+static bool parse_options(int argc, char** argv, options_t&);
+static bool parse_number(string_t const& option, char const* value, long min, long max, long&);
+static bool run_tasks(kzh::worker_pool const&, size_t count, kzh::worker_pool::task_t const&);
+static bool list_files(path_t const& tree, std::map<string_t, path_t>&);
+static bool digest_entry(options_t const&, entry_t&);
+static bool encode_entry(options_t const&, entry_t&);
+static bool copy_entry(options_t const&, entry_t const&);
+static Json make_manifest(options_t const&, std::vector<entry_t> const&);
+
+int main(int argc, char** argv) {
+  options_t options;
+
+  options.identity = "Base";
+  options.hasher = kzh::hasher::find("MD5");
+  options.codec = kzh::delta_codec::find("rsync");
+  options.signature_options = kzh::signature_options_t(0, 0);
+  options.concurrency = std::thread::hardware_concurrency();
+
+  kzh::logger::enable_timestamps(false);
+
+  if (!parse_options(argc, argv, options)) {
+    print_usage();
+    return 1;
+  }
+
+  // the shared cdc codec digests chunks on a single thread, large files are
+  // split up over -j threads like they are for librsync
+  std::unique_ptr<kzh::cdc_encoder> cdc;
+
+  if (options.codec->name() == "cdc") {
+    cdc.reset(new kzh::cdc_encoder(kzh::cdc_encoder::DEFAULT_AVERAGE_CHUNK_SIZE, options.concurrency));
+    options.codec = cdc.get();
+  }
+
+  // merge both trees into one list, ordered by path
+  std::map<string_t, path_t> old_files;
+  std::map<string_t, path_t> new_files;
+  std::map<string_t, entry_t> merged;
+
+  if (!list_files(options.old_tree, old_files) || !list_files(options.new_tree, new_files)) {
+    return 1;
+  }
+
+  for (auto const& file : old_files) {
+    entry_t &entry = merged[file.first];
+    entry.path = file.first;
+    entry.in_old = true;
+  }
+
+  for (auto const& file : new_files) {
+    entry_t &entry = merged[file.first];
+    entry.path = file.first;
+    entry.in_new = true;
+  }
+
+  std::vector<entry_t> entries;
+
+  for (auto const& pair : merged) {
+    entries.push_back(pair.second);
+  }
+
+  const kzh::worker_pool workers(options.concurrency);
+
+  logger.info() << "Digesting " << entries.size() << " files using " << workers.size() << " threads...";
+
+  if (!run_tasks(workers, entries.size(), [&](size_t i) { return digest_entry(options, entries[i]); })) {
+    return 1;
+  }
+
+  // the release is identified by the contents of the new tree unless told
+  // otherwise
+  if (options.id.empty()) {
+    std::ostringstream listing;
+
+    for (auto const& entry : entries) {
+      if (entry.in_new) {
+        listing << entry.path << ':' << entry.new_checksum << '\n';
+      }
+    }
+
+    options.id = options.hasher->hex_digest(listing.str()).digest;
+  }
+
+  if (options.url_prefix.empty()) {
+    options.url_prefix = "/" + options.id;
+  }
+
+  boost::system::error_code ec;
+
+  fs::create_directories(options.output_path, ec);
+
+  if (ec) {
+    logger.error() << "Unable to create the release directory " << options.output_path << ": " << ec.message();
+    return 1;
+  }
+
+  logger.info() << "Generating deltas and copying new files...";
+
+  if (!run_tasks(workers, entries.size(), [&](size_t i) {
+    return encode_entry(options, entries[i]) && copy_entry(options, entries[i]);
+  })) {
+    return 1;
+  }
+
+  const path_t manifest_path(options.output_path / "release.json");
+  std::ofstream manifest(manifest_path.string().c_str(), std::ios_base::trunc);
+
+  manifest << make_manifest(options, entries).dump() << std::endl;
+  manifest.close();
+
+  if (manifest.fail()) {
+    logger.error() << "Unable to write the release manifest to " << manifest_path;
+    return 1;
+  }
+
+  logger.info() << "Release " << options.id << " written to " << options.output_path;
+
+  if (options.hasher->name() != "MD5") {
+    logger.notice()
+      << "The version manifest must specify \"hasher\": \"" << options.hasher->name()
+      << "\" for the checksums to be verified.";
+  }
+
+  return 0;
+}
+
+void print_usage() {
+  std::cerr
+    << "Usage: kzh-mkrelease [options] OLD_TREE NEW_TREE\n"
+    << "\n"
+    << "Generates the release manifest, the deltas, and the new files needed to\n"
+    << "patch OLD_TREE into NEW_TREE.\n"
+    << "\n"
+    << "Options:\n"
+    << "  -o PATH     directory to write the release to (default: ./release)\n"
+    << "  -i ID       release id (default: digest of the new tree)\n"
+    << "  -t TAG      release tag\n"
+    << "  -H ID       id of the release this one follows\n"
+    << "  -T ID       id of the release a cumulative release leads to; -i must\n"
+    << "              then give the cumulative release an id of its own\n"
+    << "  -I NAME     identity list of the release (default: Base)\n"
+    << "  -u PREFIX   URL prefix the release directory is served at (default: /ID)\n"
+    << "  -x HASHER   hasher to calculate checksums with (default: MD5)\n"
+    << "  -e CODEC    delta encoding, rsync or cdc (default: rsync)\n"
+    << "  -b LENGTH   librsync block length (default: picked by file size)\n"
+    << "  -s LENGTH   librsync strong sum length (default: 32)\n"
+    << "  -j COUNT    number of threads to process files, and large files, on\n";
+}
+
+bool parse_options(int argc, char** argv, options_t& options) {
+  // every option takes a value
+  static const string_t known_options("oitHTIuxebsj");
+  std::vector<string_t> trees;
+
+  options.output_path = "release";
+
+  for (int i = 1; i < argc; ++i) {
+    const string_t arg = argv[i];
+    const bool has_value = i + 1 < argc;
+    const bool is_option = arg.size() > 1 && arg[0] == '-';
+
+    if (is_option && (arg.size() != 2 || known_options.find(arg[1]) == string_t::npos)) {
+      logger.error() << "Unknown option " << arg;
+      return false;
+    }
+    else if (is_option && !has_value) {
+      logger.error() << "Missing value for " << arg;
+      return false;
+    }
+    else if (arg == "-o") {
+      options.output_path = string_t(argv[++i]);
+    }
+    else if (arg == "-i") {
+      options.id = argv[++i];
+    }
+    else if (arg == "-t") {
+      options.tag = argv[++i];
+    }
+    else if (arg == "-H") {
+      options.head = argv[++i];
+    }
+    else if (arg == "-T") {
+      options.target = argv[++i];
+    }
+    else if (arg == "-I") {
+      options.identity = argv[++i];
+    }
+    else if (arg == "-u") {
+      options.url_prefix = argv[++i];
+    }
+    else if (arg == "-x") {
+      options.hasher = kzh::hasher::find(argv[++i]);
+
+      if (!options.hasher) {
+        logger.error() << "Unknown hasher " << argv[i];
+        return false;
+      }
+    }
+    else if (arg == "-e") {
+      options.codec = kzh::delta_codec::find(argv[++i]);
+
+      if (!options.codec) {
+        logger.error() << "Unknown delta encoding " << argv[i];
+        return false;
+      }
+    }
+    else if (arg == "-b") {
+      long length;
+
+      if (!parse_number(arg, argv[++i], 1, std::numeric_limits<int>::max(), length)) {
+        return false;
+      }
+
+      options.signature_options.block_length = static_cast<size_t>(length);
+    }
+    else if (arg == "-s") {
+      long length;
+
+      if (!parse_number(arg, argv[++i], 1, RS_MAX_STRONG_SUM_LENGTH, length)) {
+        return false;
+      }
+
+      options.signature_options.strong_length = static_cast<size_t>(length);
+    }
+    else if (arg == "-j") {
+      long count;
+
+      if (!parse_number(arg, argv[++i], 1, std::numeric_limits<int>::max(), count)) {
+        return false;
+      }
+
+      options.concurrency = static_cast<int>(count);
+    }
+    else {
+      trees.push_back(arg);
+    }
+  }
+
+  if (trees.size() != 2) {
+    return false;
+  }
+
+  if (!options.target.empty() && (options.id.empty() || options.id == options.target)) {
+    logger.error() << "A cumulative release needs an id (-i) other than the one it leads to.";
+    return false;
+  }
+
+  options.old_tree = trees[0];
+  options.new_tree = trees[1];
+
+  boost::system::error_code ec;
+
+  if (!fs::is_directory(options.old_tree, ec) || !fs::is_directory(options.new_tree, ec)) {
+    logger.error() << "Both trees must be existing directories.";
+    return false;
+  }
+
+  return true;
+}
+
+/**
+ * Parses the whole of @value as a decimal number between @min and @max,
+ * logging an error naming @option if it isn't one.
+ */
+bool parse_number(string_t const& option, char const* value, long min, long max, long& number) {
+  char* end = nullptr;
+
+  errno = 0;
+  number = std::strtol(value, &end, 10);
+
+  if (end == value || *end != '\0' || errno == ERANGE || number < min || number > max) {
+    logger.error() << "Invalid value for " << option << ": " << value << " (expected " << min << " to " << max << ")";
+    return false;
+  }
+
+  return true;
+}
+
+/**
+ * Runs the tasks on the workers, logging rather than propagating whatever
+ * one of them throws.
+ */
+bool run_tasks(kzh::worker_pool const& workers, size_t count, kzh::worker_pool::task_t const& task) {
+  try {
+    return workers.run(count, task);
+  }
+  catch (std::exception const& e) {
+    logger.error() << e.what();
+    return false;
+  }
+}
+
+/**
+ * Lists the regular files under @tree, keyed by their path relative to it
+ * in the form the manifests use ("/bin/app").
+ *
+ * @return false if the tree couldn't be walked in full
+ */
+bool list_files(path_t const& tree, std::map<string_t, path_t>& files) {
+  const size_t prefix_length = tree.generic_string().size();
+  boost::system::error_code ec;
+  fs::recursive_directory_iterator it(tree, ec), end;
+
+  for (; !ec && it != end; it.increment(ec)) {
+    const fs::file_status status(it->status(ec));
+
+    if (ec) {
+      break;
+    }
+
+    if (fs::is_regular_file(status)) {
+      string_t relative(it->path().generic_string().substr(prefix_length));
+
+      if (relative.empty() || relative[0] != '/') {
+        relative.insert(0, "/");
+      }
+
+      files[relative] = it->path();
+    }
+  }
+
+  if (ec) {
+    logger.error() << "Unable to list the files in " << tree << ": " << ec.message();
+    return false;
+  }
+
+  return true;
+}
+
+bool digest_entry(options_t const& options, entry_t& entry) {
+  if (entry.in_old) {
+    kzh::hasher::digest_rc rc = options.hasher->hex_digest(options.old_tree / entry.path);
+
+    if (!rc.valid) {
+      logger.error() << "Unable to digest " << options.old_tree / entry.path;
+      return false;
+    }
+
+    entry.old_checksum = rc.digest;
+  }
+
+  if (entry.in_new) {
+    const path_t path(options.new_tree / entry.path);
+    kzh::hasher::digest_rc rc = options.hasher->hex_digest(path);
+
+    if (!rc.valid) {
+      logger.error() << "Unable to digest " << path;
+      return false;
+    }
+
+    boost::system::error_code ec;
+    const fs::file_status status(fs::status(path, ec));
+
+    if (!ec) {
+      entry.new_size = fs::file_size(path, ec);
+    }
+
+    if (ec) {
+      logger.error() << "Unable to stat " << path << ": " << ec.message();
+      return false;
+    }
+
+    entry.new_checksum = rc.digest;
+    entry.executable = (status.permissions() & fs::owner_exe) != 0;
+  }
+
+  return true;
+}
+
+/**
+ * Generates the delta of a file that exists in both trees but has changed.
+ * Deltas that aren't any smaller than the new file are discarded and the file
+ * is shipped whole instead.
+ */
+bool encode_entry(options_t const& options, entry_t& entry) {
+  if (!entry.in_old || !entry.in_new || entry.old_checksum == entry.new_checksum) {
+    return true;
+  }
+
+  const path_t basis_path(options.old_tree / entry.path);
+  const path_t new_path(options.new_tree / entry.path);
+  const path_t delta_path(options.output_path / "deltas" / (entry.path + ".delta"));
+  kzh::delta_encoder encoder;
+  boost::system::error_code ec;
+  const kzh::uint64_t basis_size = fs::file_size(basis_path, ec);
+
+  if (ec) {
+    logger.error() << "Unable to stat " << basis_path << ": " << ec.message();
+    return false;
+  }
+
+  kzh::signature_options_t signature_options(kzh::signature_options_t::for_size(basis_size));
+
+  if (options.signature_options.block_length > 0) {
+    signature_options.block_length = options.signature_options.block_length;
+  }
+
+  if (options.signature_options.strong_length > 0) {
+    signature_options.strong_length = options.signature_options.strong_length;
+  }
+
+  // other workers may be creating the same parent directories, in which case
+  // losing the race is fine as long as the directory ends up being there
+  fs::create_directories(delta_path.parent_path(), ec);
+
+  boost::system::error_code exists_ec;
+
+  if (ec && !fs::is_directory(delta_path.parent_path(), exists_ec)) {
+    logger.error() << "Unable to create the directory of " << delta_path << ": " << ec.message();
+    return false;
+  }
+
+  std::ifstream basis(basis_path.string().c_str(), std::ios_base::binary);
+  std::ofstream delta(delta_path.string().c_str(), std::ios_base::binary | std::ios_base::trunc);
+  std::stringstream signature;
+
+  if (!basis.is_open() || !delta.is_open()) {
+    logger.error() << "Unable to open " << (basis.is_open() ? delta_path : basis_path);
+    return false;
+  }
+
+  rs_result rc;
+
+  if (options.codec->name() != "rsync") {
+    std::ifstream new_file(new_path.string().c_str(), std::ios_base::binary);
+
+    if (!new_file.is_open()) {
+      logger.error() << "Unable to open " << new_path;
+      return false;
+    }
+
+    rc = options.codec->signature(basis, signature);
+
+    if (rc == RS_DONE) {
+      rc = options.codec->delta(signature, new_file, delta);
+    }
+  }
+  else {
+    rc = encoder.signature(basis, signature, signature_options);
+
+    // large files are split up and searched on all cores, which matters when a
+    // handful of them take longer than the rest of the tree combined
+    std::unique_ptr<kzh::mapped_file> mapped_new_file(kzh::file_manager().map_file(new_path));
+
+    if (rc == RS_DONE && mapped_new_file) {
+      rc = encoder.delta(signature, mapped_new_file->data(), mapped_new_file->size(), delta, options.concurrency);
+    }
+    else if (rc == RS_DONE) {
+      std::ifstream new_file(new_path.string().c_str(), std::ios_base::binary);
+
+      if (!new_file.is_open()) {
+        logger.error() << "Unable to open " << new_path;
+        return false;
+      }
+
+      rc = encoder.delta(signature, new_file, delta);
+    }
+  }
+
+  delta.close();
+
+  if (rc != RS_DONE || delta.fail()) {
+    logger.error() << "Unable to generate the delta of " << entry.path << ", " << options.codec->name() << " rc: " << rc;
+    return false;
+  }
+
+  entry.delta_size = fs::file_size(delta_path, ec);
+
+  if (ec) {
+    logger.error() << "Unable to stat " << delta_path << ": " << ec.message();
+    return false;
+  }
+
+  if (entry.delta_size >= entry.new_size) {
+    logger.debug() << "Shipping " << entry.path << " whole, its delta isn't any smaller";
+    fs::remove(delta_path, ec);
+    return true;
+  }
+
+  kzh::hasher::digest_rc digest(options.hasher->hex_digest(delta_path));
+
+  if (!digest.valid) {
+    logger.error() << "Unable to digest " << delta_path;
+    return false;
+  }
+
+  entry.has_delta = true;
+  entry.delta_checksum = digest.digest;
+
+  return true;
+}
+
+/** Copies files that are new or are shipped whole into the release. */
+bool copy_entry(options_t const& options, entry_t const& entry) {
+  if (!entry.in_new || entry.has_delta || (entry.in_old && entry.old_checksum == entry.new_checksum)) {
+    return true;
+  }
+
+  const path_t destination(options.output_path / "files" / entry.path);
+  boost::system::error_code ec;
+
+  fs::create_directories(destination.parent_path(), ec);
+  fs::remove(destination, ec);
+  fs::copy_file(options.new_tree / entry.path, destination, ec);
+
+  if (ec) {
+    logger.error() << "Unable to copy " << entry.path << " into the release: " << ec.message();
+    return false;
+  }
+
+  return true;
+}
+
+Json make_manifest(options_t const& options, std::vector<entry_t> const& entries) {
+  Json::array operations;
+  kzh::uint64_t size = 0;
+
+  for (auto const& entry : entries) {
+    const bool changed = entry.old_checksum != entry.new_checksum;
+
+    if (entry.in_old && (!entry.in_new || (changed && !entry.has_delta))) {
+      operations.push_back(Json::object {
+        { "type", "delete" },
+        { "target", entry.path },
+      });
+    }
+
+    if (entry.has_delta) {
+      Json::object delta {
+        { "checksum", entry.delta_checksum },
+        { "size", static_cast<double>(entry.delta_size) },
+        { "url", options.url_prefix + "/deltas" + entry.path + ".delta" },
+      };
+
+      if (options.codec->name() != "rsync") {
+        delta["encoding"] = options.codec->name();
+      }
+
+      if (options.signature_options.block_length > 0) {
+        delta["block_length"] = static_cast<int>(options.signature_options.block_length);
+      }
+
+      if (options.signature_options.strong_length > 0) {
+        delta["strong_length"] = static_cast<int>(options.signature_options.strong_length);
+      }
+
+      size += entry.delta_size;
+
+      operations.push_back(Json::object {
+        { "type", "update" },
+        { "basis", Json::object {
+          { "pre_checksum", entry.old_checksum },
+          { "post_checksum", entry.new_checksum },
+          { "filepath", entry.path },
+        } },
+        { "delta", delta },
+      });
+    }
+    else if (entry.in_new && (!entry.in_old || changed)) {
+      Json::object create {
+        { "type", "create" },
+        { "source", Json::object {
+          { "url", options.url_prefix + "/files" + entry.path },
+          { "checksum", entry.new_checksum },
+          { "size", static_cast<double>(entry.new_size) },
+        } },
+        { "destination", entry.path },
+      };
+
+      if (entry.executable) {
+        create["flags"] = Json::object { { "executable", true } };
+      }
+
+      size += entry.new_size;
+
+      operations.push_back(create);
+    }
+  }
+
+  Json::object release {
+    { "id", options.id },
+    { "identity", options.identity },
+    { "size", static_cast<double>(size) },
+    { "operations", operations },
+  };
+
+  if (!options.tag.empty()) {
+    release["tag"] = options.tag;
+  }
+
+  if (!options.head.empty()) {
+    release["head"] = options.head;
+  }
+
+  if (!options.target.empty()) {
+    release["target"] = options.target;
+  }
+
+  return Json::object {
+    { "releases", Json::array { release } },
+  };
+}